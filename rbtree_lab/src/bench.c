@@ -0,0 +1,286 @@
+#include "rbtree.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// rbtree 벤치마크 드라이버
+//
+//   ./bench [-n 1000,1000000] [-w seq,rand,zipf] [-o ops] [-m insert,find,erase]
+//           [-s seed] [-f csv|json]
+//
+// 크기 x 워크로드 조합마다 자식 프로세스를 하나씩 띄워서 n개로 트리를 채운 뒤
+// ops번의 연산을 섞어 수행한다. 연산 종류별로 처리량과 p50/p99/p999 지연시간,
+// 그리고 그 조합에서 트리를 채운 직후까지의 최대 RSS를 출력한다.
+
+enum { OP_INSERT, OP_FIND, OP_ERASE, OP_COUNT };
+static const char *op_names[OP_COUNT] = { "insert", "find", "erase" };
+
+typedef enum { WL_SEQ, WL_RAND, WL_ZIPF } workload_t;
+static const char *workload_names[] = { "seq", "rand", "zipf" };
+
+// 자식이 행을 하나라도 출력했으면 이 값으로 끝난다 (JSON 구분자를 부모가 정하도록)
+#define BENCH_EXIT_ROWS 3
+
+typedef struct {
+  size_t ops;
+  int mix[OP_COUNT];  // 연산 비율 (%)
+  uint64_t seed;
+  int json;
+} bench_opts;
+
+// xorshift64*
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 2685821657736338717ULL;
+}
+
+static double rng_unit(void) {
+  return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// YCSB 방식의 Zipfian 생성기 (theta = 0.99)
+typedef struct {
+  uint64_t n;
+  double theta, alpha, zetan, eta;
+} zipf_gen;
+
+static void zipf_init(zipf_gen *z, uint64_t n, double theta) {
+  double zeta2 = 1.0 + pow(0.5, theta);
+  z->zetan = 0;
+  for (uint64_t i = 1; i <= n; i++) {
+    z->zetan += 1.0 / pow((double)i, theta);
+  }
+  z->n = n;
+  z->theta = theta;
+  z->alpha = 1.0 / (1.0 - theta);
+  z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static uint64_t zipf_next(const zipf_gen *z) {
+  double u = rng_unit();
+  double uz = u * z->zetan;
+  if (uz < 1.0) return 0;
+  if (uz < 1.0 + pow(0.5, z->theta)) return 1;
+  uint64_t r = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+  return r < z->n ? r : z->n - 1;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, double q) {
+  if (n == 0) return 0;
+  size_t i = (size_t)(q * (n - 1) + 0.5);
+  return sorted[i];
+}
+
+// 연산에 쓸 key. 키 공간은 [0, 2n)이라 find/erase는 절반 정도 적중한다
+static key_t next_key(workload_t wl, size_t n, const zipf_gen *z, size_t i) {
+  uint64_t space = 2 * (uint64_t)n;
+  switch (wl) {
+    case WL_SEQ:
+      return (key_t)(i % space);
+    case WL_RAND:
+      return (key_t)(rng_next() % space);
+    default:
+      // 인기 있는 rank가 키 공간 곳곳에 흩어지도록 섞는다
+      return (key_t)((zipf_next(z) * 2654435761ULL) % space);
+  }
+}
+
+// 출력한 행 수를 반환한다
+static int run_one(workload_t wl, size_t n, const bench_opts *o, int first_row) {
+  rng_state = o->seed ? o->seed : 88172645463325252ULL;
+
+  zipf_gen z = { 0 };
+  if (wl == WL_ZIPF) zipf_init(&z, 2 * (uint64_t)n, 0.99);
+
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    key_t key = (wl == WL_SEQ) ? (key_t)i : (key_t)(rng_next() % (2 * (uint64_t)n));
+    rbtree_insert(t, key);
+  }
+
+  // 최대 RSS는 트리를 채운 직후에 잰다. 아래의 지연시간 버퍼(연산 수 x 8바이트 x 3)까지
+  // 재면 작은 트리에서는 하네스의 메모리가 대부분이 된다
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  // 처리량은 종류마다 그 연산에 쓴 시간의 합으로 나눈다. 전체 경과 시간으로 나누면
+  // 섞은 비율만 드러날 뿐 연산 하나의 비용은 알 수 없다
+  uint64_t *lat[OP_COUNT];
+  size_t cnt[OP_COUNT] = { 0 };
+  uint64_t busy_ns[OP_COUNT] = { 0 };
+  for (int k = 0; k < OP_COUNT; k++) {
+    lat[k] = malloc(o->ops * sizeof(uint64_t));
+    if (lat[k] == NULL) {
+      fprintf(stderr, "bench: cannot allocate %zu latency samples\n", o->ops);
+      _exit(1);
+    }
+  }
+
+  size_t seq = n;
+  for (size_t i = 0; i < o->ops; i++) {
+    int r = (int)(rng_next() % 100);
+    int op = (r < o->mix[OP_INSERT]) ? OP_INSERT
+             : (r < o->mix[OP_INSERT] + o->mix[OP_FIND]) ? OP_FIND : OP_ERASE;
+    key_t key = next_key(wl, n, &z, seq++);
+
+    uint64_t t0 = now_ns();
+    if (op == OP_INSERT) {
+      rbtree_insert(t, key);
+    } else if (op == OP_FIND) {
+      rbtree_find(t, key);
+    } else {
+      node_t *p = rbtree_find(t, key);
+      if (p != t->nil) rbtree_erase(t, p);
+    }
+    uint64_t ns = now_ns() - t0;
+    lat[op][cnt[op]++] = ns;
+    busy_ns[op] += ns;
+  }
+
+  int rows = 0;
+  for (int k = 0; k < OP_COUNT; k++) {
+    if (cnt[k] == 0) continue;
+    qsort(lat[k], cnt[k], sizeof(uint64_t), cmp_u64);
+    double ops_per_sec = busy_ns[k] ? cnt[k] * 1e9 / busy_ns[k] : 0;
+    uint64_t p50 = percentile(lat[k], cnt[k], 0.50);
+    uint64_t p99 = percentile(lat[k], cnt[k], 0.99);
+    uint64_t p999 = percentile(lat[k], cnt[k], 0.999);
+
+    if (o->json) {
+      printf("%s  {\"workload\": \"%s\", \"size\": %zu, \"op\": \"%s\", \"count\": %zu, "
+             "\"ops_per_sec\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+             "\"peak_rss_kb\": %ld}",
+             first_row ? "" : ",\n", workload_names[wl], n, op_names[k], cnt[k], ops_per_sec,
+             (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999,
+             ru.ru_maxrss);
+      first_row = 0;
+    } else {
+      printf("%s,%zu,%s,%zu,%.0f,%llu,%llu,%llu,%ld\n", workload_names[wl], n, op_names[k],
+             cnt[k], ops_per_sec, (unsigned long long)p50, (unsigned long long)p99,
+             (unsigned long long)p999, ru.ru_maxrss);
+    }
+    rows++;
+  }
+  fflush(stdout);
+
+  for (int k = 0; k < OP_COUNT; k++) {
+    free(lat[k]);
+  }
+  delete_rbtree(t);
+  return rows;
+}
+
+// -n의 크기 목록이 모두 1 이상의 정수인지 확인한다 (0이면 키 공간이 비어 나눌 수 없다)
+static int sizes_valid(const char *arg) {
+  char sizes[256];
+  snprintf(sizes, sizeof(sizes), "%s", arg);
+  int count = 0;
+  char *save = NULL;
+  for (char *tok = strtok_r(sizes, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    char *end;
+    if (strtoull(tok, &end, 10) == 0 || *end != '\0') return 0;
+    count++;
+  }
+  return count > 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-n sizes] [-w seq,rand,zipf] [-o ops] [-m insert,find,erase] "
+          "[-s seed] [-f csv|json]\n",
+          prog);
+  exit(2);
+}
+
+int main(int argc, char *argv[]) {
+  bench_opts o = { 1000000, { 20, 60, 20 }, 0, 0 };
+  char sizes_arg[256] = "1000,100000,1000000";
+  char workloads_arg[64] = "seq,rand,zipf";
+
+  int c;
+  while ((c = getopt(argc, argv, "n:w:o:m:s:f:h")) != -1) {
+    switch (c) {
+      case 'n':
+        snprintf(sizes_arg, sizeof(sizes_arg), "%s", optarg);
+        if (!sizes_valid(sizes_arg)) {
+          fprintf(stderr, "-n: comma-separated sizes of at least 1 expected\n");
+          return 2;
+        }
+        break;
+      case 'w': snprintf(workloads_arg, sizeof(workloads_arg), "%s", optarg); break;
+      case 'o': o.ops = strtoull(optarg, NULL, 10); break;
+      case 's': o.seed = strtoull(optarg, NULL, 10); break;
+      case 'f': o.json = (strcmp(optarg, "json") == 0); break;
+      case 'm':
+        if (sscanf(optarg, "%d,%d,%d", &o.mix[OP_INSERT], &o.mix[OP_FIND], &o.mix[OP_ERASE]) != 3 ||
+            o.mix[OP_INSERT] + o.mix[OP_FIND] + o.mix[OP_ERASE] != 100) {
+          fprintf(stderr, "-m: three percentages summing to 100 expected\n");
+          return 2;
+        }
+        break;
+      default: usage(argv[0]);
+    }
+  }
+
+  if (o.json) {
+    printf("[\n");
+  } else {
+    printf("workload,size,op,count,ops_per_sec,p50_ns,p99_ns,p999_ns,peak_rss_kb\n");
+  }
+  fflush(stdout);
+
+  int first_row = 1;
+  for (char *wl_tok = strtok(workloads_arg, ","); wl_tok; wl_tok = strtok(NULL, ",")) {
+    workload_t wl = WL_SEQ;
+    if (strcmp(wl_tok, "seq") == 0) wl = WL_SEQ;
+    else if (strcmp(wl_tok, "rand") == 0) wl = WL_RAND;
+    else if (strcmp(wl_tok, "zipf") == 0) wl = WL_ZIPF;
+    else usage(argv[0]);
+
+    char sizes[256];
+    snprintf(sizes, sizeof(sizes), "%s", sizes_arg);
+    char *save = NULL;
+    for (char *n_tok = strtok_r(sizes, ",", &save); n_tok; n_tok = strtok_r(NULL, ",", &save)) {
+      size_t n = strtoull(n_tok, NULL, 10);
+
+      // 조합마다 새 프로세스에서 돌려야 peak RSS가 섞이지 않는다
+      pid_t pid = fork();
+      if (pid == 0) {
+        _exit(run_one(wl, n, &o, first_row) > 0 ? BENCH_EXIT_ROWS : 0);
+      }
+      int status;
+      waitpid(pid, &status, 0);
+      if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0 && WEXITSTATUS(status) != BENCH_EXIT_ROWS)) {
+        fprintf(stderr, "bench: %s/%zu failed\n", wl_tok, n);
+        return 1;
+      }
+      // 아무것도 출력하지 않은 조합 뒤에는 다음 행이 여전히 첫 행이다
+      if (WEXITSTATUS(status) == BENCH_EXIT_ROWS) first_row = 0;
+    }
+  }
+
+  if (o.json) printf("\n]\n");
+  return 0;
+}
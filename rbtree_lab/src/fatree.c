@@ -0,0 +1,669 @@
+#include "rbtree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// 기본 int key일 때만 노드 안의 비교를 SIMD로 한다. 다른 key 타입은 스칼라 루프
+// (분기 없이 비교 결과를 더하므로 컴파일러가 벡터화할 수 있다)
+#if defined(__SSE2__) && !defined(RBTREE_KEY_TYPE)
+#include <immintrin.h>
+#define FAT_SIMD
+#endif
+
+// 찾지 못했을 때 돌려주는 sentinel. 아무도 쓰지 않는다
+static node_t nil_node;
+
+#ifdef FAT_SIMD
+// keys[i] < key이면 i번 비트가 켜진 마스크 (16개 모두 비교)
+static inline unsigned lt_mask(const key_t *keys, const key_t key) {
+#ifdef __AVX2__
+  const __m256i k = _mm256_set1_epi32(key);
+  const __m256i a = _mm256_load_si256((const __m256i *)keys);
+  const __m256i b = _mm256_load_si256((const __m256i *)(keys + 8));
+  return (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, a))) |
+         (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, b))) << 8;
+#else
+  const __m128i k = _mm_set1_epi32(key);
+  unsigned mask = 0;
+  for (int i = 0; i < 4; i++) {
+    const __m128i v = _mm_load_si128((const __m128i *)keys + i);
+    mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, k))) << (4 * i);
+  }
+  return mask;
+#endif
+}
+
+// keys[i] > key이면 i번 비트가 켜진 마스크
+static inline unsigned gt_mask(const key_t *keys, const key_t key) {
+#ifdef __AVX2__
+  const __m256i k = _mm256_set1_epi32(key);
+  const __m256i a = _mm256_load_si256((const __m256i *)keys);
+  const __m256i b = _mm256_load_si256((const __m256i *)(keys + 8));
+  return (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, k))) |
+         (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(b, k))) << 8;
+#else
+  const __m128i k = _mm_set1_epi32(key);
+  unsigned mask = 0;
+  for (int i = 0; i < 4; i++) {
+    const __m128i v = _mm_load_si128((const __m128i *)keys + i);
+    mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, k))) << (4 * i);
+  }
+  return mask;
+#endif
+}
+#endif
+
+// keys[0, n) 중 key보다 작은 것의 수
+static inline int rank_lt(const key_t *keys, const int n, const key_t key) {
+#ifdef FAT_SIMD
+  return __builtin_popcount(lt_mask(keys, key) & ((1u << n) - 1));
+#else
+  int r = 0;
+  for (int i = 0; i < n; i++) {
+    r += keys[i] < key;
+  }
+  return r;
+#endif
+}
+
+// keys[0, n) 중 key 이하인 것의 수
+static inline int rank_le(const key_t *keys, const int n, const key_t key) {
+#ifdef FAT_SIMD
+  return n - __builtin_popcount(gt_mask(keys, key) & ((1u << n) - 1));
+#else
+  int r = 0;
+  for (int i = 0; i < n; i++) {
+    r += !(key < keys[i]);
+  }
+  return r;
+#endif
+}
+
+// SIMD는 count 뒤의 key까지 읽으므로 빈 칸도 0으로 초기화해 둔다
+static fat_node_t *new_fat_node(int leaf) {
+  fat_node_t *node = aligned_alloc(_Alignof(fat_node_t), sizeof(fat_node_t));
+  if (node == NULL) return NULL;
+
+  memset(node, 0, sizeof(*node));
+  node->leaf = leaf;
+  return node;
+}
+
+static node_t *alloc_item(rbtree *t) {
+  node_t *item;
+  if (t->free_list != NULL) {
+    item = t->free_list;
+    t->free_list = item->next_free;
+  } else {
+    if (t->chunks == NULL || t->chunks->used == FAT_CHUNK) {
+      node_chunk_t *chunk = malloc(sizeof(*chunk));
+      if (chunk == NULL) return NULL;
+      chunk->next = t->chunks;
+      chunk->used = 0;
+      t->chunks = chunk;
+    }
+    item = &t->chunks->nodes[t->chunks->used++];
+  }
+
+#ifdef RBTREE_VALUE_TYPE
+  // rbtree_insert_value가 아닌 경로로 만든 노드의 value는 0이다
+  memset(&item->value, 0, sizeof(item->value));
+#endif
+  return item;
+}
+
+static void free_item(rbtree *t, node_t *item) {
+  item->next_free = t->free_list;
+  t->free_list = item;
+}
+
+static int item_index(const fat_node_t *leaf, const node_t *item) {
+  int i = 0;
+  while (leaf->items[i] != item) {
+    i++;
+  }
+  return i;
+}
+
+static int child_index(const fat_node_t *parent, const fat_node_t *child) {
+  int i = 0;
+  while (parent->children[i] != child) {
+    i++;
+  }
+  return i;
+}
+
+rbtree *new_rbtree(void) {
+  rbtree *t = calloc(1, sizeof(*t));
+  if (t == NULL) return NULL;
+
+  t->nil = &nil_node;
+  return t;
+}
+
+static void free_subtree(fat_node_t *node) {
+  if (!node->leaf) {
+    for (int i = 0; i <= node->count; i++) {
+      free_subtree(node->children[i]);
+    }
+  }
+  free(node);
+}
+
+void delete_rbtree(rbtree *t) {
+  if (t == NULL) return;
+
+  if (t->root != NULL) free_subtree(t->root);
+  while (t->chunks != NULL) {
+    node_chunk_t *next = t->chunks->next;
+    free(t->chunks);
+    t->chunks = next;
+  }
+  free(t);
+}
+
+// 꽉 찬 노드에 하나를 더 넣으면 반으로 쪼개고 가운데 key를 부모로 올린다.
+// 쪼개기는 루트까지 이어질 수 있으므로, 필요한 노드를 미리 spare에 잡아 두고 쓴다.
+static void insert_parent(rbtree *t, fat_node_t *left, const key_t sep, fat_node_t *right,
+                          fat_node_t **spare) {
+  fat_node_t *parent = left->parent;
+  if (parent == NULL) {
+    parent = *spare++;
+    parent->count = 1;
+    parent->keys[0] = sep;
+    parent->children[0] = left;
+    parent->children[1] = right;
+    left->parent = right->parent = parent;
+    t->root = parent;
+    return;
+  }
+
+  const int idx = child_index(parent, left);
+  if (parent->count < FAT_KEYS) {
+    memmove(parent->keys + idx + 1, parent->keys + idx, (parent->count - idx) * sizeof(key_t));
+    memmove(parent->children + idx + 2, parent->children + idx + 1,
+            (parent->count - idx) * sizeof(fat_node_t *));
+    parent->keys[idx] = sep;
+    parent->children[idx + 1] = right;
+    parent->count++;
+    right->parent = parent;
+    return;
+  }
+
+  key_t keys[FAT_KEYS + 1];
+  fat_node_t *children[FAT_KEYS + 2];
+  memcpy(keys, parent->keys, idx * sizeof(key_t));
+  keys[idx] = sep;
+  memcpy(keys + idx + 1, parent->keys + idx, (FAT_KEYS - idx) * sizeof(key_t));
+  memcpy(children, parent->children, (idx + 1) * sizeof(fat_node_t *));
+  children[idx + 1] = right;
+  memcpy(children + idx + 2, parent->children + idx + 1, (FAT_KEYS - idx) * sizeof(fat_node_t *));
+
+  const int mid = (FAT_KEYS + 1) / 2;
+  fat_node_t *sibling = *spare++;
+  parent->count = mid;
+  memcpy(parent->keys, keys, mid * sizeof(key_t));
+  memcpy(parent->children, children, (mid + 1) * sizeof(fat_node_t *));
+  sibling->count = FAT_KEYS - mid;
+  memcpy(sibling->keys, keys + mid + 1, sibling->count * sizeof(key_t));
+  memcpy(sibling->children, children + mid + 1, (sibling->count + 1) * sizeof(fat_node_t *));
+  for (int i = 0; i <= parent->count; i++) {
+    parent->children[i]->parent = parent;
+  }
+  for (int i = 0; i <= sibling->count; i++) {
+    sibling->children[i]->parent = sibling;
+  }
+
+  insert_parent(t, parent, keys[mid], sibling, spare);
+}
+
+static void split_leaf(rbtree *t, fat_node_t *leaf, const int pos, node_t *item,
+                       fat_node_t **spare) {
+  key_t keys[FAT_KEYS + 1];
+  node_t *items[FAT_KEYS + 1];
+  memcpy(keys, leaf->keys, pos * sizeof(key_t));
+  keys[pos] = item->key;
+  memcpy(keys + pos + 1, leaf->keys + pos, (FAT_KEYS - pos) * sizeof(key_t));
+  memcpy(items, leaf->items, pos * sizeof(node_t *));
+  items[pos] = item;
+  memcpy(items + pos + 1, leaf->items + pos, (FAT_KEYS - pos) * sizeof(node_t *));
+
+  const int half = (FAT_KEYS + 1) / 2;
+  fat_node_t *right = *spare++;
+  leaf->count = half;
+  memcpy(leaf->keys, keys, half * sizeof(key_t));
+  memcpy(leaf->items, items, half * sizeof(node_t *));
+  right->count = FAT_KEYS + 1 - half;
+  memcpy(right->keys, keys + half, right->count * sizeof(key_t));
+  memcpy(right->items, items + half, right->count * sizeof(node_t *));
+  item->leaf = leaf;
+  for (int i = 0; i < right->count; i++) {
+    right->items[i]->leaf = right;
+  }
+
+  right->next = leaf->next;
+  if (right->next != NULL) right->next->prev = right;
+  right->prev = leaf;
+  leaf->next = right;
+
+  insert_parent(t, leaf, right->keys[0], right, spare);
+}
+
+// 같은 key는 이미 있는 것들 뒤에 넣는다 (rbtree_insert와 같은 multiset 규칙)
+node_t *rbtree_insert(rbtree *t, const key_t key) {
+  if (t == NULL) return NULL;
+
+  node_t *item = alloc_item(t);
+  if (item == NULL) return NULL;
+  item->key = key;
+
+  if (t->root == NULL) {
+    t->root = new_fat_node(1);
+    if (t->root == NULL) {
+      free_item(t, item);
+      return NULL;
+    }
+  }
+
+  fat_node_t *leaf = t->root;
+  while (!leaf->leaf) {
+    leaf = leaf->children[rank_le(leaf->keys, leaf->count, key)];
+  }
+  item->leaf = leaf;
+
+  // 꽉 찬 노드가 이어진 만큼 쪼개지고, 루트까지 차 있으면 새 루트가 하나 더 필요하다
+  fat_node_t *spare[64];
+  int need = 0;
+  for (fat_node_t *cur = leaf; cur != NULL && cur->count == FAT_KEYS; cur = cur->parent) {
+    need += (cur->parent == NULL) ? 2 : 1;
+  }
+  for (int i = 0; i < need; i++) {
+    spare[i] = new_fat_node(i == 0);
+    if (spare[i] == NULL) {
+      while (i-- > 0) {
+        free(spare[i]);
+      }
+      free_item(t, item);
+      return NULL;
+    }
+  }
+
+  const int pos = rank_le(leaf->keys, leaf->count, key);
+  if (leaf->count < FAT_KEYS) {
+    memmove(leaf->keys + pos + 1, leaf->keys + pos, (leaf->count - pos) * sizeof(key_t));
+    memmove(leaf->items + pos + 1, leaf->items + pos, (leaf->count - pos) * sizeof(node_t *));
+    leaf->keys[pos] = key;
+    leaf->items[pos] = item;
+    leaf->count++;
+  } else {
+    split_leaf(t, leaf, pos, item, spare);
+  }
+  t->size++;
+  return item;
+}
+
+#ifdef RBTREE_VALUE_TYPE
+node_t *rbtree_insert_value(rbtree *t, const key_t key, const value_t value) {
+  node_t *node = rbtree_insert(t, key);
+  if (node != NULL) node->value = value;
+  return node;
+}
+#endif
+
+// parent->children[idx + 1]을 children[idx]에 합치고 둘 사이의 구분 key를 지운다
+static void merge_children(rbtree *t, fat_node_t *parent, const int idx) {
+  fat_node_t *left = parent->children[idx];
+  fat_node_t *right = parent->children[idx + 1];
+
+  if (left->leaf) {
+    memcpy(left->keys + left->count, right->keys, right->count * sizeof(key_t));
+    memcpy(left->items + left->count, right->items, right->count * sizeof(node_t *));
+    for (int i = 0; i < right->count; i++) {
+      right->items[i]->leaf = left;
+    }
+    left->count += right->count;
+    left->next = right->next;
+    if (left->next != NULL) left->next->prev = left;
+  } else {
+    left->keys[left->count] = parent->keys[idx];
+    memcpy(left->keys + left->count + 1, right->keys, right->count * sizeof(key_t));
+    memcpy(left->children + left->count + 1, right->children,
+           (right->count + 1) * sizeof(fat_node_t *));
+    for (int i = 0; i <= right->count; i++) {
+      right->children[i]->parent = left;
+    }
+    left->count += right->count + 1;
+  }
+  free(right);
+
+  memmove(parent->keys + idx, parent->keys + idx + 1, (parent->count - idx - 1) * sizeof(key_t));
+  memmove(parent->children + idx + 1, parent->children + idx + 2,
+          (parent->count - idx - 1) * sizeof(fat_node_t *));
+  parent->count--;
+}
+
+// key가 FAT_MIN개보다 적어진 노드를 형제에게서 빌려 오거나 형제와 합쳐 복구한다
+static void rebalance(rbtree *t, fat_node_t *node) {
+  fat_node_t *parent = node->parent;
+  const int idx = child_index(parent, node);
+  fat_node_t *left = idx > 0 ? parent->children[idx - 1] : NULL;
+  fat_node_t *right = idx < parent->count ? parent->children[idx + 1] : NULL;
+
+  if (left != NULL && left->count > FAT_MIN) {
+    // 왼쪽 형제의 마지막 것을 맨 앞으로 옮긴다
+    memmove(node->keys + 1, node->keys, node->count * sizeof(key_t));
+    if (node->leaf) {
+      memmove(node->items + 1, node->items, node->count * sizeof(node_t *));
+      node->keys[0] = left->keys[left->count - 1];
+      node->items[0] = left->items[left->count - 1];
+      node->items[0]->leaf = node;
+      parent->keys[idx - 1] = node->keys[0];
+    } else {
+      memmove(node->children + 1, node->children, (node->count + 1) * sizeof(fat_node_t *));
+      node->keys[0] = parent->keys[idx - 1];
+      node->children[0] = left->children[left->count];
+      node->children[0]->parent = node;
+      parent->keys[idx - 1] = left->keys[left->count - 1];
+    }
+    node->count++;
+    left->count--;
+  } else if (right != NULL && right->count > FAT_MIN) {
+    // 오른쪽 형제의 첫 것을 맨 뒤로 옮긴다
+    if (node->leaf) {
+      node->keys[node->count] = right->keys[0];
+      node->items[node->count] = right->items[0];
+      node->items[node->count]->leaf = node;
+      memmove(right->items, right->items + 1, (right->count - 1) * sizeof(node_t *));
+    } else {
+      node->keys[node->count] = parent->keys[idx];
+      node->children[node->count + 1] = right->children[0];
+      node->children[node->count + 1]->parent = node;
+      parent->keys[idx] = right->keys[0];
+      memmove(right->children, right->children + 1, right->count * sizeof(fat_node_t *));
+    }
+    memmove(right->keys, right->keys + 1, (right->count - 1) * sizeof(key_t));
+    node->count++;
+    right->count--;
+    if (node->leaf) parent->keys[idx] = right->keys[0];
+  } else {
+    merge_children(t, parent, left != NULL ? idx - 1 : idx);
+
+    if (parent == t->root) {
+      if (parent->count == 0) {
+        t->root = parent->children[0];
+        t->root->parent = NULL;
+        free(parent);
+      }
+    } else if (parent->count < FAT_MIN) {
+      rebalance(t, parent);
+    }
+  }
+}
+
+int rbtree_erase(rbtree *t, node_t *p) {
+  if (!t || !p || p == t->nil) return -1;
+
+  fat_node_t *leaf = p->leaf;
+  const int i = item_index(leaf, p);
+  memmove(leaf->keys + i, leaf->keys + i + 1, (leaf->count - i - 1) * sizeof(key_t));
+  memmove(leaf->items + i, leaf->items + i + 1, (leaf->count - i - 1) * sizeof(node_t *));
+  leaf->count--;
+  t->size--;
+  free_item(t, p);
+
+  if (leaf == t->root) {
+    if (leaf->count == 0) {
+      free(leaf);
+      t->root = NULL;
+    }
+  } else if (leaf->count < FAT_MIN) {
+    rebalance(t, leaf);
+  }
+  return 0;
+}
+
+// key 이상인 첫 노드. 없으면 nil
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key) {
+  if (t->root == NULL) return t->nil;
+
+  const fat_node_t *node = t->root;
+  while (!node->leaf) {
+    node = node->children[rank_lt(node->keys, node->count, key)];
+  }
+
+  // 이 leaf의 key가 모두 작으면 답은 다음 leaf의 첫 key다
+  const int i = rank_lt(node->keys, node->count, key);
+  if (i < node->count) return node->items[i];
+  return node->next != NULL ? node->next->items[0] : t->nil;
+}
+
+// key보다 큰 첫 노드. 없으면 nil
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key) {
+  if (t->root == NULL) return t->nil;
+
+  const fat_node_t *node = t->root;
+  while (!node->leaf) {
+    node = node->children[rank_le(node->keys, node->count, key)];
+  }
+
+  const int i = rank_le(node->keys, node->count, key);
+  if (i < node->count) return node->items[i];
+  return node->next != NULL ? node->next->items[0] : t->nil;
+}
+
+node_t *rbtree_find(const rbtree *t, const key_t key) {
+  node_t *node = rbtree_lower_bound(t, key);
+  return (node != t->nil && node->key == key) ? node : t->nil;
+}
+
+// 노드가 캐시 라인 단위라 레벨마다 미스가 한 번뿐이어서, 탐색을 번갈아 진행하지 않고
+// 차례로 찾는다.
+size_t rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out) {
+  size_t found = 0;
+  for (size_t i = 0; i < n; i++) {
+    out[i] = rbtree_find(t, keys[i]);
+    found += (out[i] != t->nil);
+  }
+  return found;
+}
+
+// [lo, hi) 구간의 노드를 key 순서대로 callback에 넘긴다.
+// callback이 0이 아닌 값을 돌려주면 중단하며, 넘긴 노드 수를 반환한다.
+size_t rbtree_range(const rbtree *t, const key_t lo, const key_t hi,
+                    rbtree_range_fn callback, void *ctx) {
+  size_t count = 0;
+  node_t *cur = rbtree_lower_bound(t, lo);
+  while (cur != t->nil && cur->key < hi) {
+    count++;
+    if (callback(cur, ctx) != 0) break;
+    cur = rbtree_next(t, cur);
+  }
+  return count;
+}
+
+node_t *rbtree_min(const rbtree *t) {
+  if (t->root == NULL) return t->nil;
+
+  const fat_node_t *node = t->root;
+  while (!node->leaf) {
+    node = node->children[0];
+  }
+  return node->items[0];
+}
+
+node_t *rbtree_max(const rbtree *t) {
+  if (t->root == NULL) return t->nil;
+
+  const fat_node_t *node = t->root;
+  while (!node->leaf) {
+    node = node->children[node->count];
+  }
+  return node->items[node->count - 1];
+}
+
+size_t rbtree_size(const rbtree *t) {
+  return t->size;
+}
+
+// 중위 순회 기준 다음 노드. 마지막 노드였으면 nil을 반환
+node_t *rbtree_next(const rbtree *t, const node_t *node) {
+  if (node == t->nil) return t->nil;
+
+  const fat_node_t *leaf = node->leaf;
+  const int i = item_index(leaf, node);
+  if (i + 1 < leaf->count) return leaf->items[i + 1];
+  return leaf->next != NULL ? leaf->next->items[0] : t->nil;
+}
+
+// 중위 순회 기준 이전 노드. 첫 노드였으면 nil을 반환
+node_t *rbtree_prev(const rbtree *t, const node_t *node) {
+  if (node == t->nil) return t->nil;
+
+  const fat_node_t *leaf = node->leaf;
+  const int i = item_index(leaf, node);
+  if (i > 0) return leaf->items[i - 1];
+  return leaf->prev != NULL ? leaf->prev->items[leaf->prev->count - 1] : t->nil;
+}
+
+rbtree_cursor rbtree_cursor_first(const rbtree *t) {
+  rbtree_cursor c = { t, rbtree_min(t) };
+  return c;
+}
+
+rbtree_cursor rbtree_cursor_last(const rbtree *t) {
+  rbtree_cursor c = { t, rbtree_max(t) };
+  return c;
+}
+
+int rbtree_cursor_valid(const rbtree_cursor *c) {
+  return c->node != c->tree->nil;
+}
+
+node_t *rbtree_cursor_next(rbtree_cursor *c) {
+  c->node = rbtree_next(c->tree, c->node);
+  return c->node;
+}
+
+node_t *rbtree_cursor_prev(rbtree_cursor *c) {
+  c->node = rbtree_prev(c->tree, c->node);
+  return c->node;
+}
+
+int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
+  if (t == NULL) return -1;
+  if (t->root == NULL) return 0;
+
+  // leaf를 연결 순서대로 훑는다
+  const fat_node_t *leaf = t->root;
+  while (!leaf->leaf) {
+    leaf = leaf->children[0];
+  }
+
+  size_t idx = 0;
+  for (; leaf != NULL && idx < n; leaf = leaf->next) {
+    size_t m = (size_t)leaf->count < n - idx ? (size_t)leaf->count : n - idx;
+    memcpy(arr + idx, leaf->keys, m * sizeof(key_t));
+    idx += m;
+  }
+  return (int)idx;
+}
+
+// 정렬된 배열을 leaf에 고르게 나눠 담고, 한 레벨씩 위로 부모를 만든다.
+// level[0, m)은 지금 레벨의 노드, mins[i]는 level[i] 서브트리의 최소 key다.
+rbtree *rbtree_from_sorted_array(const key_t *arr, const size_t n) {
+  rbtree *t = new_rbtree();
+  if (t == NULL || n == 0) return t;
+
+  size_t m = (n + FAT_KEYS - 1) / FAT_KEYS;
+  fat_node_t **level = malloc(m * sizeof(fat_node_t *));
+  key_t *mins = malloc(m * sizeof(key_t));
+  size_t built = 0;
+  if (level == NULL || mins == NULL) goto fail;
+
+  for (size_t pos = 0; built < m;) {
+    fat_node_t *leaf = new_fat_node(1);
+    if (leaf == NULL) goto fail;
+    const size_t j = built++;
+    level[j] = leaf;
+
+    leaf->count = (int)(n / m + (j < n % m));
+    for (int i = 0; i < leaf->count; i++) {
+      node_t *item = alloc_item(t);
+      if (item == NULL) goto fail;
+      item->key = arr[pos++];
+      item->leaf = leaf;
+      leaf->keys[i] = item->key;
+      leaf->items[i] = item;
+    }
+    mins[j] = leaf->keys[0];
+    if (j > 0) {
+      leaf->prev = level[j - 1];
+      level[j - 1]->next = leaf;
+    }
+  }
+
+  while (m > 1) {
+    const size_t parents = (m + FAT_KEYS) / (FAT_KEYS + 1);
+    size_t off = 0;
+    for (built = 0; built < parents; built++) {
+      fat_node_t *parent = new_fat_node(0);
+      if (parent == NULL) {
+        // 이미 만든 부모들과 아직 붙지 않은 자식들을 정리한다
+        for (size_t i = off; i < m; i++) {
+          free_subtree(level[i]);
+        }
+        goto fail;
+      }
+
+      const size_t children = m / parents + (built < m % parents);
+      parent->count = (int)children - 1;
+      for (size_t i = 0; i < children; i++) {
+        parent->children[i] = level[off + i];
+        level[off + i]->parent = parent;
+        if (i > 0) parent->keys[i - 1] = mins[off + i];
+      }
+      mins[built] = mins[off];
+      level[built] = parent;
+      off += children;
+    }
+    m = parents;
+  }
+
+  t->root = level[0];
+  t->size = n;
+  free(mins);
+  free(level);
+  return t;
+
+fail:
+  for (size_t i = 0; i < built; i++) {
+    free_subtree(level[i]);
+  }
+  free(mins);
+  free(level);
+  delete_rbtree(t);
+  return NULL;
+}
+
+// 정렬되지 않은 배열은 복사본을 정렬한 뒤 rbtree_from_sorted_array로 만든다
+rbtree *rbtree_from_array(const key_t *arr, const size_t n) {
+  if (n == 0) return new_rbtree();
+
+  key_t *sorted = malloc(n * sizeof(key_t));
+  if (sorted == NULL) return NULL;
+  memcpy(sorted, arr, n * sizeof(key_t));
+  rbtree_sort_keys(sorted, n);
+
+  rbtree *t = rbtree_from_sorted_array(sorted, n);
+  free(sorted);
+  return t;
+}
+
+// 다시 짓는 경로가 없으므로 정렬된 순서로 하나씩 반영한다
+size_t rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n) {
+  return rbtree_batch_apply(t, keys, n, 0, NULL);
+}
+
+size_t rbtree_erase_batch(rbtree *t, const key_t *keys, const size_t n) {
+  return rbtree_batch_apply(t, keys, n, 1, NULL);
+}
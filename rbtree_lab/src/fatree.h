@@ -0,0 +1,121 @@
+#ifndef _FATREE_H_
+#define _FATREE_H_
+
+// rbtree.h의 API를 fat node 엔진으로 구현할 때의 타입과 함수 (-DRBTREE_FAT).
+// key_t, value_t, color_t는 rbtree.h에서 먼저 정의한 뒤 이 헤더를 포함한다.
+#ifndef _RBTREE_H_
+#error "include rbtree.h instead"
+#endif
+
+#if defined(RBTREE_ORDER_STAT) || defined(RBTREE_INTERVAL)
+#error "RBTREE_ORDER_STAT and RBTREE_INTERVAL are not supported by the fat node engine"
+#endif
+
+#ifdef RBTREE_MULTISET
+#error "RBTREE_MULTISET is not supported by the fat node engine"
+#endif
+
+#ifdef RBTREE_STATS
+#error "RBTREE_STATS is not supported by the fat node engine"
+#endif
+
+// 노드 하나에 key를 캐시 라인 한 줄(int key 기준 16개)만큼 담는 B+ 트리.
+// 노드 안에서는 key 전체를 SIMD로 한 번에 비교하고(compare + movemask) 비트 수를
+// 세어 위치를 구하므로, 레벨마다 캐시 미스가 한 번이고 트리 높이는 log16(n)이다.
+//
+// rbtree.h와 같은 함수 이름과 node_t 핸들을 쓴다. node_t는 key마다 하나씩 따로
+// 할당되어 erase 전까지 주소가 바뀌지 않고, 자기가 들어 있는 leaf를 가리킨다.
+// 서브트리를 옮기는 연산(split/join, 집합 연산)과 순서 통계는 제공하지 않는다.
+#define FAT_KEYS (64 / sizeof(key_t) >= 8 ? 64 / sizeof(key_t) : 8)
+#define FAT_MIN (FAT_KEYS / 2)  // 루트가 아닌 노드가 가져야 할 최소 key 수
+
+typedef struct node_t {
+  key_t key;
+#ifdef RBTREE_VALUE_TYPE
+  value_t value;
+#endif
+  union {
+    struct fat_node_t *leaf;    // 이 key가 들어 있는 leaf
+    struct node_t *next_free;   // 풀에 반환된 동안
+  };
+} node_t;
+
+// leaf는 key와 핸들을, 내부 노드는 구분 key와 자식을 담는다.
+// 내부 노드에서 children[i]의 key는 모두 keys[i - 1] 이상 keys[i] 이하다.
+typedef struct fat_node_t {
+  _Alignas(64) key_t keys[FAT_KEYS];
+  union {
+    struct fat_node_t *children[FAT_KEYS + 1];
+    node_t *items[FAT_KEYS];
+  };
+  struct fat_node_t *parent;
+  struct fat_node_t *prev, *next;  // 같은 레벨의 leaf끼리 key 순서로 연결
+  int count;                       // key 수 (내부 노드의 자식은 count + 1개)
+  int leaf;
+} fat_node_t;
+
+#define FAT_CHUNK 256
+
+// node_t 핸들을 FAT_CHUNK개씩 잡아 두는 묶음
+typedef struct node_chunk_t {
+  struct node_chunk_t *next;
+  size_t used;
+  node_t nodes[FAT_CHUNK];
+} node_chunk_t;
+
+typedef struct {
+  fat_node_t *root;     // 빈 트리는 NULL
+  size_t size;          // key 수
+  node_t *nil;          // 찾지 못했을 때 돌려주는 sentinel (모든 트리가 공유)
+  node_t *free_list;
+  node_chunk_t *chunks;
+} rbtree;
+
+// 중위 순회용 커서. node가 tree->nil이면 끝에 도달한 상태
+typedef struct {
+  const rbtree *tree;
+  node_t *node;
+} rbtree_cursor;
+
+// rbtree_range 콜백. 0이 아닌 값을 반환하면 순회를 멈춘다
+typedef int (*rbtree_range_fn)(node_t *node, void *ctx);
+
+rbtree *new_rbtree(void);
+void delete_rbtree(rbtree *t);
+
+node_t *rbtree_insert(rbtree *t, const key_t);
+#ifdef RBTREE_VALUE_TYPE
+node_t *rbtree_insert_value(rbtree *t, const key_t key, const value_t value);
+#endif
+
+node_t *rbtree_find(const rbtree *, const key_t);
+size_t rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out);
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key);
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key);
+size_t rbtree_range(const rbtree *t, const key_t lo, const key_t hi,
+                    rbtree_range_fn callback, void *ctx);
+node_t *rbtree_min(const rbtree *);
+node_t *rbtree_max(const rbtree *);
+size_t rbtree_size(const rbtree *t);
+
+int rbtree_erase(rbtree *t, node_t *p);
+
+// 정렬한 keys를 순서대로 하나씩 반영한다 (rbtree.h의 batch 연산과 같은 의미, rbtree_batch_apply)
+size_t rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n);
+size_t rbtree_erase_batch(rbtree *t, const key_t *keys, const size_t n);
+
+node_t *rbtree_next(const rbtree *t, const node_t *node);
+node_t *rbtree_prev(const rbtree *t, const node_t *node);
+
+rbtree_cursor rbtree_cursor_first(const rbtree *t);
+rbtree_cursor rbtree_cursor_last(const rbtree *t);
+int rbtree_cursor_valid(const rbtree_cursor *c);
+node_t *rbtree_cursor_next(rbtree_cursor *c);
+node_t *rbtree_cursor_prev(rbtree_cursor *c);
+
+int rbtree_to_array(const rbtree *t, key_t *arr, const size_t);
+
+rbtree *rbtree_from_sorted_array(const key_t *arr, const size_t n);
+rbtree *rbtree_from_array(const key_t *arr, const size_t n);
+
+#endif  // _FATREE_H_
@@ -1,22 +1,197 @@
 #include "rbtree.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+// slab 하나에 담는 노드 수: 작게 시작해서 두 배씩 키운다
+#define SLAB_MIN_NODES 32
+#define SLAB_MAX_NODES 8192
+
+// 락 없이 읽는 쪽(rbtree_concurrent.c)이 따라가는 링크(root, left, right)를 고칠 때 쓴다.
+// 읽는 쪽의 acquire load와 짝을 맞춰 쓰기가 쪼개지거나 합쳐지지 않고, 어느 링크로 노드에
+// 닿든 그 노드의 초기화(key, 자식)가 먼저 보인다. x86에서는 보통의 mov와 같다
+#define LINK_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+
+#ifdef RBTREE_STATS
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_USDT(name, t, node, arg) DTRACE_PROBE3(rbtree, name, t, node, arg)
+#endif
+#endif
+#ifndef TRACE_USDT
+#define TRACE_USDT(name, t, node, arg) ((void)0)
+#endif
+
+static rbtree_trace_fn trace_fn;
+static void *trace_ctx;
+
+void rbtree_set_trace(rbtree_trace_fn fn, void *ctx) {
+  trace_fn = fn;
+  trace_ctx = ctx;
+}
+
+// 조회는 const 트리에도 세므로 const를 벗기고, 동시에 읽는 스레드끼리 겹쳐도 되도록 원자적으로 더한다
+#define STAT_ADD(t, field, n) \
+  __atomic_fetch_add(&((rbtree *)(t))->stats.field, (n), __ATOMIC_RELAXED)
+#define TRACE(ev, name, t, node, arg)                              \
+  do {                                                             \
+    TRACE_USDT(name, t, node, arg);                                \
+    if (trace_fn != NULL) trace_fn(ev, t, node, arg, trace_ctx);   \
+  } while (0)
+#else
+#define STAT_ADD(t, field, n) ((void)(t), (void)(n))
+#define TRACE(ev, name, t, node, arg) ((void)(t), (void)(node), (void)(arg))
+#endif
+
+// 노드 하나가 나타내는 key 수
+#ifdef RBTREE_MULTISET
+#define NODE_COUNT(node) ((node)->count)
+#else
+#define NODE_COUNT(node) 1
+#endif
+
+// 크기를 모르는 트리(RBTREE_SIZE_UNKNOWN)는 rbtree_size가 셀 때까지 그대로 둔다
+static inline void size_add(rbtree *t, size_t n) {
+  if (t->size != RBTREE_SIZE_UNKNOWN) t->size += n;
+}
+
+static inline void size_sub(rbtree *t, size_t n) {
+  if (t->size != RBTREE_SIZE_UNKNOWN) t->size -= n;
+}
+
+// split, join, 집합 연산 뒤의 크기. 순서 통계가 있으면 루트에서 바로 안다
+static size_t derived_size(const rbtree *t, size_t size) {
+#ifdef RBTREE_ORDER_STAT
+  (void)size;
+  return t->root->size;
+#else
+  return size;
+#endif
+}
+
+// 모든 트리가 공유하는 sentinel. 어떤 연산도 nil에 쓰지 않는다.
+static node_t nil_node = {
+  .color  = RBTREE_BLACK,
+  .parent = &nil_node,
+  .left   = &nil_node,
+  .right  = &nil_node,
+};
+
+#ifdef RBTREE_AUGMENTED
+// 자식들의 값으로 node의 부가 정보를 다시 계산한다
+static void node_update(node_t *node) {
+#ifdef RBTREE_ORDER_STAT
+#ifdef RBTREE_MULTISET
+  node->size = node->left->size + node->right->size + node->count;
+#else
+  node->size = node->left->size + node->right->size + 1;
+#endif
+#endif
+#ifdef RBTREE_INTERVAL
+  // nil의 max_hi는 key 타입의 최솟값으로 둘 수 없으므로 nil인 자식은 건너뛴다
+  node->max_hi = node->hi;
+  if (node->left != &nil_node && node->max_hi < node->left->max_hi) {
+    node->max_hi = node->left->max_hi;
+  }
+  if (node->right != &nil_node && node->max_hi < node->right->max_hi) {
+    node->max_hi = node->right->max_hi;
+  }
+#endif
+}
+
+// node부터 루트까지 부가 정보를 갱신
+static void update_to_root(rbtree *t, node_t *node) {
+  while (node != t->nil) {
+    node_update(node);
+    node = node->parent;
+  }
+}
+#endif
+
+static node_pool_t *new_pool(void) {
+  node_pool_t *pool = calloc(1, sizeof(*pool));
+  if (pool) pool->refs = 1;
+  return pool;
+}
+
+// 풀의 참조를 하나 놓는다. 마지막 참조였으면 slab을 해제하고 forward 쪽 참조도 놓는다
+static void pool_release(node_pool_t *pool) {
+  while (pool != NULL && --pool->refs == 0) {
+    node_slab_t *slab = pool->slabs;
+    while (slab != NULL) {
+      node_slab_t *next = slab->next;
+      free(slab);
+      slab = next;
+    }
+    node_pool_t *next = pool->forward;
+    free(pool);
+    pool = next;
+  }
+}
+
+// src의 slab과 free list를 dst로 옮기고, src는 dst를 가리키게 한다
+static void pool_merge(node_pool_t *dst, node_pool_t *src) {
+  if (src->slabs != NULL) {
+    if (dst->slabs == NULL) {
+      dst->slabs = src->slabs;
+      dst->last_slab = src->last_slab;
+      dst->used = src->used;
+    } else {
+      // dst의 맨 앞 slab은 계속 bump 할당에 쓰도록 그 뒤에 끼워 넣는다
+      src->last_slab->next = dst->slabs->next;
+      if (dst->last_slab == dst->slabs) dst->last_slab = src->last_slab;
+      dst->slabs->next = src->slabs;
+    }
+  }
+  if (src->free_list != NULL) {
+    src->free_tail->right = dst->free_list;
+    if (dst->free_list == NULL) dst->free_tail = src->free_tail;
+    dst->free_list = src->free_list;
+  }
+
+  src->slabs = src->last_slab = NULL;
+  src->free_list = src->free_tail = NULL;
+  src->forward = dst;
+  dst->refs++;
+}
+
+// 트리가 실제로 쓰는 풀. 병합된 풀을 가리키고 있었으면 최종 풀로 옮겨 간다
+node_pool_t *tree_pool(rbtree *t) {
+  node_pool_t *pool = t->pool;
+  if (pool->forward == NULL) return pool;
+
+  node_pool_t *root = pool->forward;
+  while (root->forward != NULL) {
+    root = root->forward;
+  }
+  root->refs++;
+  t->pool = root;
+  pool_release(pool);
+  return root;
+}
+
+// 두 트리가 같은 풀을 쓰도록 t2의 풀을 t1의 풀로 합친다 (노드를 옮기기 전에 호출)
+void share_pool(rbtree *t1, rbtree *t2) {
+  node_pool_t *p1 = tree_pool(t1), *p2 = tree_pool(t2);
+  if (p1 != p2) {
+    pool_merge(p1, p2);
+    tree_pool(t2);
+  }
+}
 
 rbtree *new_rbtree(void) {
   rbtree *p = calloc(1, sizeof(*p));
   if (!p) return NULL;
 
-  node_t *nil = malloc(sizeof(*nil));
-  if (!nil) {
+  p->pool = new_pool();
+  if (!p->pool) {
     free(p); return NULL;
   }
 
-  nil->color = RBTREE_BLACK;
-  nil->key   = 0;
-  nil->left = nil->right = nil->parent = nil;
-
-  p->nil  = nil;
-  p->root = nil;
+  p->nil  = &nil_node;
+  p->root = p->nil;
+  p->leftmost = p->rightmost = p->nil;
 
   return p;
 }
@@ -25,67 +200,158 @@ rbtree *new_rbtree(void) {
 void delete_rbtree(rbtree *t) {
   if (t == NULL) return;
 
-  delete_node(t->root, t->nil);
-  free(t->nil);
+  // 노드는 전부 slab 안에 있으므로 풀을 놓으면 slab 단위로 한 번에 반환된다
+  pool_release(t->pool);
   free(t);
 }
 
-void delete_node(node_t *node, node_t *nil) {
-  if (node == nil) return;
+// node를 루트로 하는 서브트리의 노드를 모두 풀에 반환.
+// 재귀 대신 parent 포인터로 후위 순회하며, 반환한 자식의 링크는 nil로 끊는다.
+// 트리의 루트를 넘기면 트리를 비운다 (size, leftmost, rightmost도 함께 되돌린다).
+void delete_node(rbtree *t, node_t *node) {
+  if (node == t->nil) return;
+  if (node == t->root) {
+    t->root = t->leftmost = t->rightmost = t->nil;
+    t->size = 0;
+  }
 
-  delete_node(node->left, nil);
-  delete_node(node->right, nil);
-  free(node);
+  node_t *cur = node;
+  while (1) {
+    if (cur->left != t->nil) {
+      cur = cur->left;
+    } else if (cur->right != t->nil) {
+      cur = cur->right;
+    } else {
+      node_t *parent = cur->parent;
+      free_node(t, cur);
+      if (cur == node) break;
+
+      if (parent->left == cur) {
+        parent->left = t->nil;
+      } else {
+        parent->right = t->nil;
+      }
+      cur = parent;
+    }
+  }
+}
+
+// 풀에서 노드 하나를 꺼낸다. 반환된 노드가 있으면 먼저 재사용
+node_t *alloc_node(rbtree *t) {
+  node_pool_t *pool = tree_pool(t);
+  node_t *node;
+
+  if (pool->free_list != NULL) {
+    node = pool->free_list;
+    pool->free_list = node->right;
+  } else {
+    if (pool->slabs == NULL || pool->used == pool->slabs->cap) {
+      size_t cap = SLAB_MIN_NODES;
+      if (pool->slabs != NULL && pool->slabs->cap < SLAB_MAX_NODES) {
+        cap = pool->slabs->cap * 2;
+      } else if (pool->slabs != NULL) {
+        cap = SLAB_MAX_NODES;
+      }
+
+      if (add_slab(t, cap) == NULL) return NULL;
+    }
+    node = &pool->slabs->nodes[pool->used++];
+  }
+
+#ifdef RBTREE_VALUE_TYPE
+  // 재사용한 노드에 지워진 노드의 value가 남지 않도록 비운다 (rbtree_insert_value가 덮어쓴다)
+  memset(&node->value, 0, sizeof(node->value));
+#endif
+  return node;
+}
+
+// cap개짜리 slab을 풀 맨 앞에 추가한다
+node_slab_t *add_slab(rbtree *t, size_t cap) {
+  node_pool_t *pool = tree_pool(t);
+  node_slab_t *slab = malloc(sizeof(*slab) + cap * sizeof(node_t));
+  if (!slab) return NULL;
+
+  TRACE(RBTREE_EV_SLAB, slab, t, NULL, sizeof(*slab) + cap * sizeof(node_t));
+  slab->cap  = cap;
+  slab->next = pool->slabs;
+  if (pool->slabs == NULL) pool->last_slab = slab;
+  pool->slabs = slab;
+  pool->used  = 0;
+  return slab;
+}
+
+// 노드를 풀의 free list에 돌려준다 (메모리는 풀이 해제될 때 반환)
+void free_node(rbtree *t, node_t *node) {
+  node_pool_t *pool = tree_pool(t);
+  if (pool->free_list == NULL) pool->free_tail = node;
+  node->right = pool->free_list;
+  pool->free_list = node;
 }
 
 void left_rotate(rbtree *t, node_t *axis){
   node_t *new_parent = axis->right;
   node_t *remain_child = axis->right->left;
+  STAT_ADD(t, rotations, 1);
+  TRACE(RBTREE_EV_ROTATE, rotate, t, axis, 0);
 
   // 축 부모 노드의 자식 포인터 변경
   if (axis->parent == t->nil) {
-    t->root = new_parent;
+    LINK_STORE(t->root, new_parent);
   } else if (axis->parent->left == axis) {
-    axis->parent->left = new_parent;
+    LINK_STORE(axis->parent->left, new_parent);
   } else {
-    axis->parent->right = new_parent;
+    LINK_STORE(axis->parent->right, new_parent);
   }
 
   // 자식 재배치
-  new_parent->left = axis;
+  LINK_STORE(new_parent->left, axis);
   new_parent->parent = axis->parent;
   axis->parent = new_parent;
 
   // 축의 오른쪽 자식 포인터 재설정
-  axis->right = remain_child;
+  LINK_STORE(axis->right, remain_child);
   if (remain_child != t->nil) {
     remain_child->parent = axis;
   }
+
+#ifdef RBTREE_AUGMENTED
+  // 축이 새 부모의 자식이 되었으므로 아래쪽부터 갱신
+  node_update(axis);
+  node_update(new_parent);
+#endif
 }
 
 void right_rotate(rbtree *t, node_t *axis){
   node_t *new_parent = axis->left;
   node_t *remain_child = axis->left->right;
+  STAT_ADD(t, rotations, 1);
+  TRACE(RBTREE_EV_ROTATE, rotate, t, axis, 1);
 
   // 축 부모 노드의 자식 포인터 변경
   if (axis->parent == t->nil) {
-    t->root = new_parent;
+    LINK_STORE(t->root, new_parent);
   } else if (axis->parent->left == axis) {
-    axis->parent->left = new_parent;
+    LINK_STORE(axis->parent->left, new_parent);
   } else {
-    axis->parent->right = new_parent;
+    LINK_STORE(axis->parent->right, new_parent);
   }
 
   // 자식 재배치
-  new_parent->right = axis;
+  LINK_STORE(new_parent->right, axis);
   new_parent->parent = axis->parent;
   axis->parent = new_parent;
 
   // 축의 왼쪽 자식 포인터 재설정
-  axis->left = remain_child;
+  LINK_STORE(axis->left, remain_child);
   if (remain_child != t->nil) {
     remain_child->parent = axis;
   }
+
+#ifdef RBTREE_AUGMENTED
+  // 축이 새 부모의 자식이 되었으므로 아래쪽부터 갱신
+  node_update(axis);
+  node_update(new_parent);
+#endif
 }
 
 void color_flip(rbtree *t, node_t *node) {
@@ -113,6 +379,7 @@ void insert_fixup(rbtree *t, node_t *node) {
   
   while (cur->parent != t->nil && cur->parent->color == RBTREE_RED) {
     if (cur->parent->parent == t->nil) break;
+    STAT_ADD(t, insert_fixups, 1);
     node_t *grandparent = cur->parent->parent;
     
     // 부모가 할아버지의 왼쪽 자식인 경우
@@ -169,19 +436,24 @@ void insert_fixup(rbtree *t, node_t *node) {
   t->root->color = RBTREE_BLACK;
 }
 
+// MULTISET이면 같은 key가 이미 있을 때 그 노드의 count만 올리고 그 노드를 반환한다
 node_t *rbtree_insert(rbtree *t, const key_t key) {
   if (t == NULL) return NULL;
-  
-  node_t *new_node = malloc(sizeof(node_t));
-  new_node->color = RBTREE_RED;
-  new_node->key = key;
-  new_node->parent = t->nil;
-  new_node->left = t->nil;
-  new_node->right = t->nil;
 
   node_t *parent = t->nil;
   node_t *cur = t->root;
   while (cur != t->nil) {
+#ifdef RBTREE_MULTISET
+    if (key == cur->key) {
+      cur->count++;
+      size_add(t, 1);
+#ifdef RBTREE_AUGMENTED
+      update_to_root(t, cur);
+#endif
+      TRACE(RBTREE_EV_INSERT, insert, t, cur, 0);
+      return cur;
+    }
+#endif
     parent = cur;
     if (key < cur->key) {
       cur = cur->left;
@@ -190,143 +462,346 @@ node_t *rbtree_insert(rbtree *t, const key_t key) {
     }
   }
 
+  node_t *new_node = alloc_node(t);
+  if (new_node == NULL) return NULL;
+  new_node->color = RBTREE_RED;
+  new_node->key = key;
+#ifdef RBTREE_MULTISET
+  new_node->count = 1;
+#endif
+#ifdef RBTREE_INTERVAL
+  new_node->hi = key;
+#endif
+  new_node->left = t->nil;
+  new_node->right = t->nil;
   new_node->parent = parent;
   if (parent == t->nil) {
-    t->root = new_node;
+    LINK_STORE(t->root, new_node);
   } else if (new_node->key < parent->key) {
-    parent->left = new_node;
+    LINK_STORE(parent->left, new_node);
   } else {
-    parent->right = new_node;
+    LINK_STORE(parent->right, new_node);
   }
 
+  // 같은 key는 오른쪽에 붙으므로 rightmost는 같은 key일 때도 바뀐다
+  size_add(t, 1);
+  if (t->leftmost == t->nil || key < t->leftmost->key) t->leftmost = new_node;
+  if (t->rightmost == t->nil || !(key < t->rightmost->key)) t->rightmost = new_node;
+
+#ifdef RBTREE_AUGMENTED
+  update_to_root(t, new_node);
+#endif
   insert_fixup(t, new_node);
+  TRACE(RBTREE_EV_INSERT, insert, t, new_node, 0);
   return new_node;
 }
 
+#ifdef RBTREE_VALUE_TYPE
+node_t *rbtree_insert_value(rbtree *t, const key_t key, const value_t value) {
+  node_t *node = rbtree_insert(t, key);
+  if (node != NULL) {
+    node->value = value;
+  }
+  return node;
+}
+#endif
+
+// rbtree_find 한 번을 기록한다. RBTREE_STATS가 없으면 node만 돌려준다
+static inline node_t *find_done(const rbtree *t, node_t *node, uint64_t compares) {
+  STAT_ADD(t, finds, 1);
+  STAT_ADD(t, find_compares, compares);
+  TRACE(RBTREE_EV_FIND, find, t, node, compares);
+  return node;
+}
+
 node_t *rbtree_find(const rbtree *t, const key_t key) {
   node_t *cur = t->root;
+  uint64_t compares = 0;
   while (cur != t->nil) {
+    compares++;
     if (key == cur->key) {
-      return cur;
+      return find_done(t, cur, compares);
     } else if (key < cur->key) {
       cur = cur->left;
     } else {
       cur = cur->right;
     }
   }
-  return t->nil;
+  return find_done(t, t->nil, compares);
 }
 
-node_t *rbtree_min(const rbtree *t) {
+// 비정렬 batch에서 동시에 내려가는 탐색 수
+#define FIND_BATCH_LANES 16
+
+// 여러 key의 탐색을 번갈아 한 단계씩 진행한다. 다음 자식을 미리 prefetch해 두면
+// 한 탐색이 cache miss를 기다리는 동안 다른 탐색들이 진행되어 지연이 겹쳐진다.
+static void find_batch_interleaved(const rbtree *t, const key_t *keys, size_t n, node_t **out) {
+  node_t *cur[FIND_BATCH_LANES];
+  int lanes[FIND_BATCH_LANES];
+
+  for (size_t base = 0; base < n; base += FIND_BATCH_LANES) {
+    int active = (n - base < FIND_BATCH_LANES) ? (int)(n - base) : FIND_BATCH_LANES;
+    for (int i = 0; i < active; i++) {
+      cur[i] = t->root;
+      lanes[i] = i;
+    }
+
+    while (active > 0) {
+      for (int j = 0; j < active;) {
+        int i = lanes[j];
+        node_t *node = cur[i];
+        const key_t key = keys[base + i];
+
+        if (node == t->nil || key == node->key) {
+          out[base + i] = node;
+          lanes[j] = lanes[--active];
+          continue;
+        }
+        node = (key < node->key) ? node->left : node->right;
+        __builtin_prefetch(node);
+        cur[i] = node;
+        j++;
+      }
+    }
+  }
+}
+
+// 오름차순 batch는 이전 key의 탐색 경로를 재사용한다.
+// 다음 key가 이전 경로를 벗어나는 곳은 이전 탐색이 왼쪽으로 꺾은 노드 중
+// key가 새 key 이하인 가장 얕은 노드뿐이므로, 왼쪽으로 꺾은 노드만 스택에 쌓아 둔다.
+static void find_batch_sorted(const rbtree *t, const key_t *keys, size_t n, node_t **out) {
+  node_t *turns[RBTREE_MAX_HEIGHT];
+  int nturns = 0;
+  node_t *resume = t->root;
+
+  for (size_t i = 0; i < n; i++) {
+    const key_t key = keys[i];
+    node_t *cur = resume;
+    while (nturns > 0 && turns[nturns - 1]->key <= key) {
+      cur = turns[--nturns];
+    }
+
+    while (cur != t->nil && key != cur->key) {
+      if (key < cur->key) {
+        turns[nturns++] = cur;
+        cur = cur->left;
+      } else {
+        cur = cur->right;
+      }
+    }
+    out[i] = cur;
+    resume = cur;
+  }
+}
+
+// keys[i]를 찾은 결과를 out[i]에 채운다 (없으면 nil). rbtree_find와 같은 노드를
+// 돌려주며, 찾은 key의 수를 반환한다.
+size_t rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out) {
+  int sorted = 1;
+  for (size_t i = 1; i < n && sorted; i++) {
+    sorted = !(keys[i] < keys[i - 1]);
+  }
+
+  if (sorted) {
+    find_batch_sorted(t, keys, n, out);
+  } else {
+    find_batch_interleaved(t, keys, n, out);
+  }
+
+  size_t found = 0;
+  for (size_t i = 0; i < n; i++) {
+    found += (out[i] != t->nil);
+  }
+  return found;
+}
+
+// key 이상인 첫 노드. 없으면 nil
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key) {
+  node_t *found = t->nil;
   node_t *cur = t->root;
-  while (cur->left != t->nil) {
-    cur = cur->left;
+  while (cur != t->nil) {
+    if (cur->key < key) {
+      cur = cur->right;
+    } else {
+      found = cur;
+      cur = cur->left;
+    }
   }
-  return cur;
+  return found;
 }
 
-node_t *rbtree_max(const rbtree *t) {
+// key보다 큰 첫 노드. 없으면 nil
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key) {
+  node_t *found = t->nil;
   node_t *cur = t->root;
-  while (cur->right != t->nil) {
-    cur = cur->right;
+  while (cur != t->nil) {
+    if (key < cur->key) {
+      found = cur;
+      cur = cur->left;
+    } else {
+      cur = cur->right;
+    }
+  }
+  return found;
+}
+
+// [lo, hi) 구간의 노드를 key 순서대로 callback에 넘긴다.
+// callback이 0이 아닌 값을 돌려주면 중단하며, 넘긴 노드 수를 반환한다.
+size_t rbtree_range(const rbtree *t, const key_t lo, const key_t hi,
+                    rbtree_range_fn callback, void *ctx) {
+  size_t count = 0;
+  node_t *cur = rbtree_lower_bound(t, lo);
+  while (cur != t->nil && cur->key < hi) {
+    count++;
+    if (callback(cur, ctx) != 0) break;
+    cur = rbtree_next(t, cur);
+  }
+  return count;
+}
+
+node_t *rbtree_min(const rbtree *t) {
+  return t->leftmost;
+}
+
+node_t *rbtree_max(const rbtree *t) {
+  return t->rightmost;
+}
+
+// key 수. split이나 집합 연산 뒤 처음 부를 때만 노드를 세어 O(n)이고 그 뒤로는 O(1).
+// 세는 쪽은 const를 벗겨 결과를 남긴다. 읽는 스레드끼리 겹치면 모두 같은 값을 쓰므로
+// 캐시는 원자적으로 읽고 쓴다
+size_t rbtree_size(const rbtree *t) {
+  size_t size = __atomic_load_n(&t->size, __ATOMIC_RELAXED);
+  if (size != RBTREE_SIZE_UNKNOWN) return size;
+
+  size = 0;
+  for (node_t *p = rbtree_min(t); p != t->nil; p = rbtree_next(t, p)) {
+    size += NODE_COUNT(p);
+  }
+  __atomic_store_n(&((rbtree *)t)->size, size, __ATOMIC_RELAXED);
+  return size;
+}
+
+// 루트에서 양 끝까지 내려가 leftmost, rightmost를 다시 찾는다. O(log n)
+void reset_bounds(rbtree *t) {
+  t->leftmost = t->rightmost = t->root;
+  if (t->root == t->nil) return;
+
+  while (t->leftmost->left != t->nil) {
+    t->leftmost = t->leftmost->left;
+  }
+  while (t->rightmost->right != t->nil) {
+    t->rightmost = t->rightmost->right;
   }
-  return cur;
 }
 
 // 부모-자식 포인터를 v로 대체
 void transplant(rbtree *t, node_t *u, node_t *v) {
   if (u->parent == t->nil)
-    t->root = v;
+    LINK_STORE(t->root, v);
   else if (u == u->parent->left)
-    u->parent->left  = v;
+    LINK_STORE(u->parent->left, v);
   else
-    u->parent->right = v;
+    LINK_STORE(u->parent->right, v);
   
+  // nil은 모든 트리가 공유하므로 건드리지 않는다 (erase가 부모를 따로 넘긴다)
   if (v != t->nil) {
     v->parent = u->parent;
   }
 }
 
 // 삭제 후 RB트리의 규칙을 복구하는 함수
-// p는 삭제된 노드 자리를 대신하게 된 fix_target 노드
-void erase_fixup(rbtree *t, node_t *x) {
+// x는 삭제된 노드 자리를 대신하게 된 노드, parent는 그 부모.
+// x가 nil일 수 있고 nil의 parent는 쓸 수 없으므로 부모를 따로 들고 다닌다.
+void erase_fixup(rbtree *t, node_t *x, node_t *parent) {
   while (x != t->root && x->color == RBTREE_BLACK) {
-    if (x == x->parent->left) {
-      node_t *w = x->parent->right;
+    STAT_ADD(t, erase_fixups, 1);
+    if (x == parent->left) {
+      node_t *w = parent->right;
       // Case 1: 형제가 RED
       if (w->color == RBTREE_RED) {
         w->color = RBTREE_BLACK;
-        x->parent->color = RBTREE_RED;
-        left_rotate(t, x->parent);
-        w = x->parent->right;
+        parent->color = RBTREE_RED;
+        left_rotate(t, parent);
+        w = parent->right;
       }
       // Case 2: 형제의 양쪽 자식이 모두 BLACK
       if (w->left->color == RBTREE_BLACK && w->right->color == RBTREE_BLACK) {
         w->color = RBTREE_RED;
-        x = x->parent;
+        x = parent;
+        parent = x->parent;
       } else {
         // Case 3: 형제의 오른쪽 자식이 BLACK
         if (w->right->color == RBTREE_BLACK) {
           w->left->color = RBTREE_BLACK;
           w->color = RBTREE_RED;
           right_rotate(t, w);
-          w = x->parent->right;
+          w = parent->right;
         }
         // Case 4: 형제의 오른쪽 자식이 RED
-        w->color = x->parent->color;
-        x->parent->color = RBTREE_BLACK;
+        w->color = parent->color;
+        parent->color = RBTREE_BLACK;
         w->right->color = RBTREE_BLACK;
-        left_rotate(t, x->parent);
+        left_rotate(t, parent);
         x = t->root;
       }
     } else {
       // x가 오른쪽 자식인 경우: 왼쪽 형제에 대해 대칭 처리
-      node_t *w = x->parent->left;
+      node_t *w = parent->left;
       // Case 1: 형제가 RED
       if (w->color == RBTREE_RED) {
         w->color = RBTREE_BLACK;
-        x->parent->color = RBTREE_RED;
-        right_rotate(t, x->parent);
-        w = x->parent->left;
+        parent->color = RBTREE_RED;
+        right_rotate(t, parent);
+        w = parent->left;
       }
       // Case 2: 형제의 양쪽 자식이 모두 BLACK
       if (w->left->color == RBTREE_BLACK && w->right->color == RBTREE_BLACK) {
         w->color = RBTREE_RED;
-        x = x->parent;
+        x = parent;
+        parent = x->parent;
       } else {
         // Case 3: 형제의 왼쪽 자식이 BLACK
         if (w->left->color == RBTREE_BLACK) {
           w->right->color = RBTREE_BLACK;
           w->color = RBTREE_RED;
           left_rotate(t, w);
-          w = x->parent->left;
+          w = parent->left;
         }
         // Case 4: 형제의 왼쪽 자식이 RED
-        w->color = x->parent->color;
-        x->parent->color = RBTREE_BLACK;
+        w->color = parent->color;
+        parent->color = RBTREE_BLACK;
         w->left->color = RBTREE_BLACK;
-        right_rotate(t, x->parent);
+        right_rotate(t, parent);
         x = t->root;
       }
     }
   }
   // 마지막으로 x를 BLACK으로
-  x->color = RBTREE_BLACK;
+  if (x != t->nil) {
+    x->color = RBTREE_BLACK;
+  }
 }
 
 
-int rbtree_erase(rbtree *t, node_t *p) {
-  if (!t || !p || p == t->nil) return -1;
-
+// p를 트리에서 떼어 내고 색을 복구한다. p의 메모리는 호출한 쪽이 처리한다
+void unlink_node(rbtree *t, node_t *p) {
   node_t *y = p;  // 트리에서 제거될 노드
   node_t *x;      // y의 자리를 대체할 노드
+  node_t *x_parent;
   color_t y_original_color = y->color;
 
+  if (p == t->leftmost) t->leftmost = rbtree_next(t, p);
+  if (p == t->rightmost) t->rightmost = rbtree_prev(t, p);
+  size_sub(t, NODE_COUNT(p));
+
   if (p->left == t->nil) {
     x = p->right;
+    x_parent = p->parent;
     transplant(t, p, p->right);
   } else if (p->right == t->nil) {
     x = p->left;
+    x_parent = p->parent;
     transplant(t, p, p->left);
   } else {
     y = p->right;
@@ -338,34 +813,120 @@ int rbtree_erase(rbtree *t, node_t *p) {
     x = y->right;
 
     if (y->parent == p) {
-      x->parent = y;
+      x_parent = y;
     } else {
+      x_parent = y->parent;
       transplant(t, y, y->right);
-      y->right = p->right;
+      LINK_STORE(y->right, p->right);
       y->right->parent = y;
     }
 
     transplant(t, p, y);
-    y->left = p->left;
+    LINK_STORE(y->left, p->left);
     y->left->parent = y;
     y->color = p->color;
   }
 
+#ifdef RBTREE_AUGMENTED
+  // 구조가 바뀐 곳은 x의 부모부터 루트까지의 경로뿐
+  update_to_root(t, x_parent);
+#endif
+
   if (y_original_color == RBTREE_BLACK) {
-      erase_fixup(t, x);
+      erase_fixup(t, x, x_parent);
   }
+}
 
-  free(p);
+int rbtree_erase(rbtree *t, node_t *p) {
+  if (!t || !p || p == t->nil) return -1;
+  TRACE(RBTREE_EV_ERASE, erase, t, p, 0);
+
+#ifdef RBTREE_MULTISET
+  // 남은 개수가 있으면 노드는 그대로 둔다
+  if (p->count > 1) {
+    p->count--;
+    size_sub(t, 1);
+#ifdef RBTREE_AUGMENTED
+    update_to_root(t, p);
+#endif
+    return 0;
+  }
+#endif
+
+  unlink_node(t, p);
+  free_node(t, p);
   return 0;
 }
 
 void inorder_fill(node_t *node, node_t *nil, key_t *arr, int *idx, const size_t n) {
-  if (node == nil || *idx >= n) return;
+  if (node == nil) return;
+
+  node_t *stop = node->parent;
+  node_t *cur = node;
+  while (cur->left != nil) {
+    cur = cur->left;
+  }
+
+  while (cur != stop && *idx < n) {
+#ifdef RBTREE_MULTISET
+    for (size_t c = 0; c < cur->count && *idx < n; c++) {
+      arr[(*idx)++] = cur->key;
+    }
+#else
+    arr[(*idx)++] = cur->key;
+#endif
+
+    if (cur->right != nil) {
+      cur = cur->right;
+      while (cur->left != nil) {
+        cur = cur->left;
+      }
+    } else {
+      // 오른쪽 자식으로 올라오는 동안은 이미 방문한 노드
+      while (cur != node && cur == cur->parent->right) {
+        cur = cur->parent;
+      }
+      cur = (cur == node) ? stop : cur->parent;
+    }
+  }
+}
+
+#ifdef RBTREE_STATS
+static size_t subtree_height(const node_t *node, const node_t *nil) {
+  if (node == nil) return 0;
+  size_t l = subtree_height(node->left, nil);
+  size_t r = subtree_height(node->right, nil);
+  return (l > r ? l : r) + 1;
+}
+
+// 카운터를 복사하고 높이, 노드 수, 풀 크기를 계산해 채운다. O(n)
+rbtree_stats_t rbtree_stats(const rbtree *t) {
+  rbtree_stats_t s;
+  s.rotations = __atomic_load_n(&t->stats.rotations, __ATOMIC_RELAXED);
+  s.insert_fixups = __atomic_load_n(&t->stats.insert_fixups, __ATOMIC_RELAXED);
+  s.erase_fixups = __atomic_load_n(&t->stats.erase_fixups, __ATOMIC_RELAXED);
+  s.finds = __atomic_load_n(&t->stats.finds, __ATOMIC_RELAXED);
+  s.find_compares = __atomic_load_n(&t->stats.find_compares, __ATOMIC_RELAXED);
+  s.height = subtree_height(t->root, t->nil);
+  s.black_height = black_height(t, t->root);
 
-  inorder_fill(node->left, nil, arr, idx, n);
-  arr[(*idx)++] = node->key;
-  inorder_fill(node->right, nil, arr, idx, n);
+  s.nodes = 0;
+  for (node_t *p = rbtree_min(t); p != t->nil; p = rbtree_next(t, p)) {
+    s.nodes++;
+  }
+
+  // const 트리이므로 tree_pool처럼 forward를 정리하지 않고 따라가기만 한다
+  const node_pool_t *pool = t->pool;
+  while (pool->forward != NULL) {
+    pool = pool->forward;
+  }
+  s.bytes = sizeof(*pool);
+  for (const node_slab_t *slab = pool->slabs; slab != NULL; slab = slab->next) {
+    s.bytes += sizeof(*slab) + slab->cap * sizeof(node_t);
+  }
+  return s;
 }
+#endif
 
 int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
   if (t == NULL) return -1;
@@ -375,3 +936,613 @@ int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
 
   return idx;
 }
+
+#ifdef RBTREE_ORDER_STAT
+// 0부터 센 k번째로 작은 노드. k가 노드 수 이상이면 nil
+// MULTISET이면 key를 count번 센 순서에서 k번째 key를 가진 노드
+node_t *rbtree_select(const rbtree *t, size_t k) {
+  node_t *cur = t->root;
+  while (cur != t->nil) {
+    size_t left_size = cur->left->size;
+    if (k < left_size) {
+      cur = cur->left;
+    } else if (k < left_size + NODE_COUNT(cur)) {
+      return cur;
+    } else {
+      k -= left_size + NODE_COUNT(cur);
+      cur = cur->right;
+    }
+  }
+  return t->nil;
+}
+
+// key보다 작은 노드의 수 (MULTISET이면 count의 합)
+size_t rbtree_rank(const rbtree *t, const key_t key) {
+  size_t rank = 0;
+  node_t *cur = t->root;
+  while (cur != t->nil) {
+    if (cur->key < key) {
+      rank += cur->left->size + NODE_COUNT(cur);
+      cur = cur->right;
+    } else {
+      cur = cur->left;
+    }
+  }
+  return rank;
+}
+#endif
+
+#ifdef RBTREE_INTERVAL
+node_t *rbtree_insert_interval(rbtree *t, const key_t lo, const key_t hi) {
+  if (hi < lo) return NULL;
+
+  node_t *node = rbtree_insert(t, lo);
+  if (node != NULL) {
+    node->hi = hi;
+    update_to_root(t, node);
+  }
+  return node;
+}
+
+// node의 서브트리에서 [lo, hi]와 겹치는 가장 왼쪽 노드. 왼쪽 서브트리의 max_hi가 lo 이상인데
+// 그 안에 겹치는 구간이 없다면 그 구간의 시작점이 hi보다 크다는 뜻이므로, node와 오른쪽
+// 서브트리도 겹칠 수 없다. 그래서 한 경로만 내려가면 된다.
+static node_t *overlap_from(const rbtree *t, node_t *node, const key_t lo, const key_t hi) {
+  node_t *cur = node;
+  while (cur != t->nil) {
+    if (cur->left != t->nil && !(cur->left->max_hi < lo)) {
+      cur = cur->left;
+    } else if (hi < cur->key) {
+      return t->nil;
+    } else if (!(cur->hi < lo)) {
+      return cur;
+    } else {
+      cur = cur->right;
+    }
+  }
+  return t->nil;
+}
+
+node_t *rbtree_overlap_first(const rbtree *t, const key_t lo, const key_t hi) {
+  return overlap_from(t, t->root, lo, hi);
+}
+
+// node 다음의 겹치는 노드. 오른쪽 서브트리를 먼저 보고, 없으면 왼쪽에서 올라온 조상과
+// 그 오른쪽 서브트리를 차례로 본다. 시작점이 hi보다 큰 조상에 닿으면 끝
+static node_t *overlap_next(const rbtree *t, node_t *node, const key_t lo, const key_t hi) {
+  node_t *found = overlap_from(t, node->right, lo, hi);
+  while (found == t->nil) {
+    node_t *child = node;
+    node = node->parent;
+    while (node != t->nil && child == node->right) {
+      child = node;
+      node = node->parent;
+    }
+    if (node == t->nil || hi < node->key) return t->nil;
+    if (!(node->hi < lo)) return node;
+    found = overlap_from(t, node->right, lo, hi);
+  }
+  return found;
+}
+
+size_t rbtree_overlap_all(const rbtree *t, const key_t lo, const key_t hi,
+                          rbtree_range_fn callback, void *ctx) {
+  size_t count = 0;
+  node_t *cur = rbtree_overlap_first(t, lo, hi);
+  while (cur != t->nil) {
+    count++;
+    if (callback(cur, ctx) != 0) break;
+    cur = overlap_next(t, cur, lo, hi);
+  }
+  return count;
+}
+#endif
+
+// 중위 순회 기준 다음 노드. 마지막 노드였으면 nil을 반환
+node_t *rbtree_next(const rbtree *t, const node_t *node) {
+  if (node == t->nil) return t->nil;
+
+  if (node->right != t->nil) {
+    node_t *cur = node->right;
+    while (cur->left != t->nil) {
+      cur = cur->left;
+    }
+    return cur;
+  }
+
+  node_t *parent = node->parent;
+  while (parent != t->nil && node == parent->right) {
+    node = parent;
+    parent = parent->parent;
+  }
+  return parent;
+}
+
+// 중위 순회 기준 이전 노드. 첫 노드였으면 nil을 반환
+node_t *rbtree_prev(const rbtree *t, const node_t *node) {
+  if (node == t->nil) return t->nil;
+
+  if (node->left != t->nil) {
+    node_t *cur = node->left;
+    while (cur->right != t->nil) {
+      cur = cur->right;
+    }
+    return cur;
+  }
+
+  node_t *parent = node->parent;
+  while (parent != t->nil && node == parent->left) {
+    node = parent;
+    parent = parent->parent;
+  }
+  return parent;
+}
+
+rbtree_cursor rbtree_cursor_first(const rbtree *t) {
+  rbtree_cursor c = { t, rbtree_min(t) };
+  return c;
+}
+
+rbtree_cursor rbtree_cursor_last(const rbtree *t) {
+  rbtree_cursor c = { t, rbtree_max(t) };
+  return c;
+}
+
+int rbtree_cursor_valid(const rbtree_cursor *c) {
+  return c->node != c->tree->nil;
+}
+
+node_t *rbtree_cursor_next(rbtree_cursor *c) {
+  c->node = rbtree_next(c->tree, c->node);
+  return c->node;
+}
+
+node_t *rbtree_cursor_prev(rbtree_cursor *c) {
+  c->node = rbtree_prev(c->tree, c->node);
+  return c->node;
+}
+
+// 정렬된 arr[lo, hi)로 높이가 최소인 서브트리를 만든다.
+// 가운데 원소를 루트로 삼으므로 빈 자리는 모두 마지막 레벨에만 생기고,
+// 마지막 레벨(red_depth)의 노드만 RED로 칠하면 black height가 같아진다.
+node_t *build_sorted(rbtree *t, node_t *nodes, const key_t *arr, size_t lo, size_t hi,
+                     node_t *parent, int depth, int red_depth) {
+  if (lo >= hi) return t->nil;
+
+  size_t mid = lo + (hi - lo) / 2;
+  node_t *node = &nodes[mid];
+  node->key    = arr[mid];
+#ifdef RBTREE_INTERVAL
+  node->hi     = arr[mid];
+#endif
+#ifdef RBTREE_VALUE_TYPE
+  memset(&node->value, 0, sizeof(node->value));
+#endif
+  node->color  = (depth == red_depth && depth > 0) ? RBTREE_RED : RBTREE_BLACK;
+  node->parent = parent;
+  node->left   = build_sorted(t, nodes, arr, lo, mid, node, depth + 1, red_depth);
+  node->right  = build_sorted(t, nodes, arr, mid + 1, hi, node, depth + 1, red_depth);
+#ifdef RBTREE_AUGMENTED
+  node_update(node);
+#endif
+  return node;
+}
+
+// 정렬된 배열로부터 O(n)에 트리를 만든다 (rbtree_to_array의 역연산)
+rbtree *rbtree_from_sorted_array(const key_t *arr, const size_t n) {
+  rbtree *t = new_rbtree();
+  if (t == NULL || n == 0) return t;
+
+#ifdef RBTREE_MULTISET
+  // 같은 key가 이어진 구간마다 노드 하나를 만든다
+  size_t nodes = 1;
+  for (size_t i = 1; i < n; i++) {
+    nodes += (arr[i] != arr[i - 1]);
+  }
+  key_t *keys = malloc(nodes * sizeof(key_t));
+  if (keys == NULL) {
+    delete_rbtree(t);
+    return NULL;
+  }
+#else
+  const size_t nodes = n;
+  const key_t *keys = arr;
+#endif
+
+  // 노드를 slab 하나에 key 순서대로 배치
+  node_slab_t *slab = add_slab(t, nodes);
+  if (slab == NULL) {
+#ifdef RBTREE_MULTISET
+    free(keys);
+#endif
+    delete_rbtree(t);
+    return NULL;
+  }
+  t->pool->used = nodes;
+
+#ifdef RBTREE_MULTISET
+  size_t j = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0 && arr[i] == arr[i - 1]) {
+      slab->nodes[j - 1].count++;
+    } else {
+      keys[j] = arr[i];
+      slab->nodes[j++].count = 1;
+    }
+  }
+#endif
+
+  int red_depth = 0;
+  for (size_t m = nodes; m > 1; m >>= 1) {
+    red_depth++;
+  }
+  t->root = build_sorted(t, slab->nodes, keys, 0, nodes, t->nil, 0, red_depth);
+  t->size = n;
+  t->leftmost = &slab->nodes[0];
+  t->rightmost = &slab->nodes[nodes - 1];
+#ifdef RBTREE_MULTISET
+  free(keys);
+#endif
+  return t;
+}
+
+// 정렬되지 않은 배열은 복사본을 정렬한 뒤 rbtree_from_sorted_array로 만든다
+rbtree *rbtree_from_array(const key_t *arr, const size_t n) {
+  if (n == 0) return new_rbtree();
+
+  key_t *sorted = malloc(n * sizeof(key_t));
+  if (sorted == NULL) return NULL;
+  for (size_t i = 0; i < n; i++) {
+    sorted[i] = arr[i];
+  }
+  rbtree_sort_keys(sorted, n);
+
+  rbtree *t = rbtree_from_sorted_array(sorted, n);
+  free(sorted);
+  return t;
+}
+
+// batch가 트리의 이 배수 이상이면 트리를 다시 짓는다. 다시 짓는 쪽은 트리의 노드를
+// 모두 훑어 노드마다 캐시 미스가 나므로, 그보다 작으면 정렬된 순서로 하나씩 반영하는 쪽이 빠르다
+#define BATCH_REBUILD_RATIO 4
+
+// key 순서로 놓인 nodes[lo, hi)의 링크를 다시 이어 높이가 최소인 서브트리를 만든다.
+// 모양과 색은 build_sorted와 같다
+static node_t *relink_sorted(rbtree *t, node_t **nodes, size_t lo, size_t hi,
+                             node_t *parent, int depth, int red_depth) {
+  if (lo >= hi) return t->nil;
+
+  size_t mid = lo + (hi - lo) / 2;
+  node_t *node = nodes[mid];
+  node->color  = (depth == red_depth && depth > 0) ? RBTREE_RED : RBTREE_BLACK;
+  node->parent = parent;
+  node->left   = relink_sorted(t, nodes, lo, mid, node, depth + 1, red_depth);
+  node->right  = relink_sorted(t, nodes, mid + 1, hi, node, depth + 1, red_depth);
+#ifdef RBTREE_AUGMENTED
+  node_update(node);
+#endif
+  return node;
+}
+
+// key 순서로 모은 nodes[0, n)만으로 t를 다시 짓는다. size는 새 key 수
+static void relink_tree(rbtree *t, node_t **nodes, size_t n, size_t size) {
+  int red_depth = 0;
+  for (size_t m = n; m > 1; m >>= 1) {
+    red_depth++;
+  }
+  t->root = relink_sorted(t, nodes, 0, n, t->nil, 0, red_depth);
+  t->size = size;
+  t->leftmost = (n > 0) ? nodes[0] : t->nil;
+  t->rightmost = (n > 0) ? nodes[n - 1] : t->nil;
+}
+
+// 트리를 key 순서로 훑으며 정렬된 keys와 합치고, 합친 노드로 트리를 다시 짓는다.
+// 새 노드를 먼저 모두 잡아 두므로 실패하면(-1) 트리는 그대로다
+static int insert_merge(rbtree *t, const key_t *keys, size_t n, size_t size) {
+#ifdef RBTREE_MULTISET
+  // 같은 key가 이어진 구간마다 노드가 많아야 하나 필요하다
+  size_t spares = 1;
+  for (size_t i = 1; i < n; i++) {
+    spares += (keys[i] != keys[i - 1]);
+  }
+#else
+  const size_t spares = n;
+#endif
+
+  // 새 노드는 nodes[size, size + spares)에 잡아 두고 합친 결과는 앞에서부터 채운다.
+  // 트리의 노드 수는 size 이하이므로 채우는 자리가 아직 꺼내지 않은 새 노드를 덮지 않는다
+  node_t **nodes = malloc((size + spares) * sizeof(node_t *));
+  if (nodes == NULL) return -1;
+  for (size_t j = 0; j < spares; j++) {
+    nodes[size + j] = alloc_node(t);
+    if (nodes[size + j] == NULL) {
+      while (j-- > 0) {
+        free_node(t, nodes[size + j]);
+      }
+      free(nodes);
+      return -1;
+    }
+  }
+
+  size_t k = 0, spare = size;
+  node_t *cur = rbtree_min(t);
+  for (size_t i = 0; i < n;) {
+    // 같은 key면 있던 노드가 먼저 온다
+    if (cur != t->nil && !(keys[i] < cur->key)) {
+      nodes[k++] = cur;
+      cur = rbtree_next(t, cur);
+      continue;
+    }
+#ifdef RBTREE_MULTISET
+    if (k > 0 && nodes[k - 1]->key == keys[i]) {
+      nodes[k - 1]->count++;
+      i++;
+      continue;
+    }
+#endif
+    node_t *node = nodes[spare++];
+    node->key = keys[i++];
+#ifdef RBTREE_MULTISET
+    node->count = 1;
+#endif
+#ifdef RBTREE_INTERVAL
+    node->hi = node->key;
+#endif
+    nodes[k++] = node;
+  }
+  while (cur != t->nil) {
+    nodes[k++] = cur;
+    cur = rbtree_next(t, cur);
+  }
+
+  // MULTISET이면 있던 노드에 합쳐져 남은 새 노드가 있다
+  while (spare < size + spares) {
+    free_node(t, nodes[spare++]);
+  }
+
+  relink_tree(t, nodes, k, size + n);
+  free(nodes);
+  return 0;
+}
+
+// batch가 트리에 비해 크면 합쳐서 다시 짓는다
+static int insert_rebuild(rbtree *t, const key_t *keys, size_t n, size_t *inserted) {
+  const size_t size = rbtree_size(t);
+  if (n / BATCH_REBUILD_RATIO < size || insert_merge(t, keys, n, size) != 0) return -1;
+  *inserted = n;
+  return 0;
+}
+
+size_t rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n) {
+  return rbtree_batch_apply(t, keys, n, 0, insert_rebuild);
+}
+
+// 트리를 key 순서로 훑으며 정렬된 keys에 맞는 노드를 빼고, 남은 노드로 트리를 다시 짓는다.
+// 지운 key 수를 *erased에 채운다. 실패하면(-1) 트리는 그대로다
+static int erase_merge(rbtree *t, const key_t *keys, size_t n, size_t size, size_t *erased) {
+  node_t **nodes = malloc(size * sizeof(node_t *));
+  if (nodes == NULL) return -1;
+
+  // 남는 노드는 앞에서부터, 빠지는 노드는 뒤에서부터 채운다. 풀에 돌려주면 right가
+  // free list로 바뀌어 rbtree_next가 따라갈 수 없으므로 다 훑은 뒤에 돌려준다
+  size_t k = 0, gone = size, i = 0;
+  *erased = 0;
+  node_t *cur = rbtree_min(t);
+  while (cur != t->nil) {
+    node_t *next = rbtree_next(t, cur);
+    while (i < n && keys[i] < cur->key) {
+      i++;
+    }
+
+    size_t hits = 0;
+    while (i < n && keys[i] == cur->key && hits < NODE_COUNT(cur)) {
+      i++;
+      hits++;
+    }
+    *erased += hits;
+    if (hits == NODE_COUNT(cur)) {
+      nodes[--gone] = cur;
+    } else {
+#ifdef RBTREE_MULTISET
+      cur->count -= hits;
+#endif
+      nodes[k++] = cur;
+    }
+    cur = next;
+  }
+
+  for (size_t j = gone; j < size; j++) {
+    free_node(t, nodes[j]);
+  }
+  relink_tree(t, nodes, k, size - *erased);
+  free(nodes);
+  return 0;
+}
+
+static int erase_rebuild(rbtree *t, const key_t *keys, size_t n, size_t *erased) {
+  const size_t size = rbtree_size(t);
+  if (n / BATCH_REBUILD_RATIO < size) return -1;
+  return erase_merge(t, keys, n, size, erased);
+}
+
+size_t rbtree_erase_batch(rbtree *t, const key_t *keys, const size_t n) {
+  if (t == NULL || t->root == t->nil) return 0;
+  return rbtree_batch_apply(t, keys, n, 1, erase_rebuild);
+}
+
+// node부터 nil까지 경로에 있는 BLACK 노드 수 (node 포함)
+int black_height(const rbtree *t, const node_t *node) {
+  int bh = 0;
+  while (node != t->nil) {
+    if (node->color == RBTREE_BLACK) bh++;
+    node = node->left;
+  }
+  return bh;
+}
+
+// 루트가 BLACK인 두 서브트리 l(black height bhl), r(bhr)을 노드 x를 가운데 두고 잇는다.
+// l의 key는 모두 x 이하, r의 key는 모두 x 이상이어야 한다.
+// 키가 큰 쪽의 바깥쪽 가장자리를 따라 내려가 black height가 같은 BLACK 노드 y를 찾고,
+// y 자리에 RED인 x를 끼운 뒤 insert_fixup으로 복구한다 (CLRS 13-2).
+// 결과 루트는 BLACK이며 그 black height를 *bh에 돌려준다. O(|bhl - bhr| + 1)
+node_t *join_nodes(rbtree *t, node_t *l, int bhl, node_t *x, node_t *r, int bhr, int *bh) {
+  // insert_fixup이 진짜 루트에서 멈추도록 BLACK인 임시 부모 아래에서 복구한다.
+  // 그러면 루트가 RED로 끝났는지 알 수 있어 black height를 다시 셀 필요가 없다.
+  node_t top = { .color = RBTREE_BLACK, .parent = t->nil, .left = t->nil, .right = t->nil };
+  rbtree sub = { .root = &top, .nil = t->nil, .pool = t->pool, .size = RBTREE_SIZE_UNKNOWN,
+                 .leftmost = t->nil, .rightmost = t->nil };
+
+  x->color = RBTREE_RED;
+  if (bhl >= bhr) {
+    node_t *parent = &top;
+    node_t *y = l;
+    int h = bhl;
+    while (h > bhr || y->color == RBTREE_RED) {
+      if (y->color == RBTREE_BLACK) h--;
+      parent = y;
+      y = y->right;
+    }
+    if (parent == &top) top.left = x; else parent->right = x;
+    x->parent = parent;
+    x->left = y;
+    x->right = r;
+    if (top.left == t->nil) top.left = l;
+  } else {
+    node_t *parent = &top;
+    node_t *y = r;
+    int h = bhr;
+    while (h > bhl || y->color == RBTREE_RED) {
+      if (y->color == RBTREE_BLACK) h--;
+      parent = y;
+      y = y->left;
+    }
+    if (parent == &top) top.left = x; else parent->left = x;
+    x->parent = parent;
+    x->left = l;
+    x->right = y;
+    if (top.left == t->nil) top.left = r;
+  }
+  if (x->left != t->nil) x->left->parent = x;
+  if (x->right != t->nil) x->right->parent = x;
+  top.left->parent = &top;
+
+#ifdef RBTREE_AUGMENTED
+  for (node_t *cur = x; cur != &top; cur = cur->parent) {
+    node_update(cur);
+  }
+#endif
+  insert_fixup(&sub, x);
+
+  node_t *root = top.left;
+  root->parent = t->nil;
+  *bh = (bhl > bhr ? bhl : bhr);
+  if (root->color == RBTREE_RED) {
+    root->color = RBTREE_BLACK;
+    (*bh)++;
+  }
+  return root;
+}
+
+// black height가 bh인 서브트리 node를 key 미만(*l)과 key 이상(*r)으로 나눈다.
+// equal_left가 참이면 key와 같은 노드도 왼쪽으로 보낸다 (key 이하 / key 초과).
+// 내려가면서 떼어 낸 노드와 반대편 서브트리를 올라오며 join_nodes로 붙인다.
+// 매 단계의 join 비용이 black height 차이만큼이라 전체가 O(log n)이다.
+void split_nodes(rbtree *t, node_t *node, int bh, const key_t key, const int equal_left,
+                 node_t **l, int *bhl, node_t **r, int *bhr) {
+  if (node == t->nil) {
+    *l = *r = t->nil;
+    *bhl = *bhr = 0;
+    return;
+  }
+
+  int child_bh = bh - (node->color == RBTREE_BLACK ? 1 : 0);
+  node_t *left = node->left, *right = node->right;
+  if (left != t->nil) left->parent = t->nil;
+  if (right != t->nil) right->parent = t->nil;
+
+  if (equal_left ? key < node->key : key <= node->key) {
+    // node와 오른쪽 서브트리는 모두 오른쪽으로 간다
+    node_t *mid;
+    int bh_mid;
+    split_nodes(t, left, child_bh, key, equal_left, l, bhl, &mid, &bh_mid);
+    int bh_right = child_bh;
+    if (right->color == RBTREE_RED) {
+      right->color = RBTREE_BLACK;
+      bh_right++;
+    }
+    *r = join_nodes(t, mid, bh_mid, node, right, bh_right, bhr);
+  } else {
+    node_t *mid;
+    int bh_mid;
+    split_nodes(t, right, child_bh, key, equal_left, &mid, &bh_mid, r, bhr);
+    int bh_left = child_bh;
+    if (left->color == RBTREE_RED) {
+      left->color = RBTREE_BLACK;
+      bh_left++;
+    }
+    *l = join_nodes(t, left, bh_left, node, mid, bh_mid, bhl);
+  }
+}
+
+// t1의 모든 key <= key <= t2의 모든 key일 때 두 트리를 O(log n)에 합친다.
+// t2는 해제되고 합쳐진 트리(t1)를 반환한다. 노드 할당에 실패하면 NULL
+rbtree *rbtree_join(rbtree *t1, const key_t key, rbtree *t2) {
+  share_pool(t1, t2);
+
+  node_t *x = alloc_node(t1);
+  if (x == NULL) return NULL;
+  x->key = key;
+#ifdef RBTREE_INTERVAL
+  x->hi = key;
+#endif
+#ifdef RBTREE_MULTISET
+  // key가 한 노드에만 있도록 양쪽 끝의 같은 key 노드를 x로 흡수한다
+  x->count = 1;
+  node_t *edge[2] = { rbtree_max(t1), rbtree_min(t2) };
+  rbtree *side[2] = { t1, t2 };
+  for (int i = 0; i < 2; i++) {
+    if (edge[i] != t1->nil && edge[i]->key == key) {
+      x->count += edge[i]->count;
+      unlink_node(side[i], edge[i]);
+      free_node(t1, edge[i]);
+    }
+  }
+#endif
+
+  size_t size = RBTREE_SIZE_UNKNOWN;
+  if (t1->size != RBTREE_SIZE_UNKNOWN && t2->size != RBTREE_SIZE_UNKNOWN) {
+    size = t1->size + NODE_COUNT(x) + t2->size;
+  }
+
+  int bh;
+  t1->root = join_nodes(t1, t1->root, black_height(t1, t1->root), x,
+                        t2->root, black_height(t2, t2->root), &bh);
+  t1->size = derived_size(t1, size);
+  reset_bounds(t1);
+  t2->root = t2->nil;
+  delete_rbtree(t2);
+  return t1;
+}
+
+// t를 key 미만인 *lo와 key 이상인 *hi로 O(log n)에 나눈다.
+// t는 *lo로 재사용되며, 두 트리는 t의 노드 풀을 함께 쓴다.
+int rbtree_split(rbtree *t, const key_t key, rbtree **lo, rbtree **hi) {
+  rbtree *r = calloc(1, sizeof(*r));
+  if (r == NULL) return -1;
+
+  r->nil = t->nil;
+  r->pool = tree_pool(t);
+  r->pool->refs++;
+
+  int bhl, bhr;
+  split_nodes(t, t->root, black_height(t, t->root), key, 0, &t->root, &bhl, &r->root, &bhr);
+  // 양쪽 크기는 세어 봐야 알 수 있으므로 첫 rbtree_size로 미룬다
+  t->size = derived_size(t, RBTREE_SIZE_UNKNOWN);
+  r->size = derived_size(r, RBTREE_SIZE_UNKNOWN);
+  reset_bounds(t);
+  reset_bounds(r);
+
+  *lo = t;
+  *hi = r;
+  return 0;
+}
@@ -2,25 +2,171 @@
 #define _RBTREE_H_
 
 #include <stddef.h>
+#include <stdint.h>
+
+// 레드블랙 트리 높이의 상한 (2 * log2(n + 1))
+#define RBTREE_MAX_HEIGHT 128
 
 typedef enum { RBTREE_RED, RBTREE_BLACK } color_t;
 
+// -DRBTREE_KEY_TYPE=int64_t 처럼 key 타입을 컴파일 시점에 바꿀 수 있다.
+// 비교는 그대로 <, == 이므로 정수/실수 같은 고정 폭 타입만 지원한다.
+#ifdef RBTREE_KEY_TYPE
+#include <sys/types.h>  // 시스템 헤더의 key_t(IPC key)를 먼저 정의해 두고 이름을 바꾼다
+#define key_t rbtree_key_t
+typedef RBTREE_KEY_TYPE key_t;
+#else
 typedef int key_t;
+#endif
+
+// -DRBTREE_VALUE_TYPE='void *' 처럼 지정하면 노드마다 value를 함께 저장한다
+// value는 rbtree_insert_value만 채우고, 다른 경로(rbtree_insert, from_array, batch, join)로
+// 만든 노드의 value는 모든 비트가 0이다
+#ifdef RBTREE_VALUE_TYPE
+typedef RBTREE_VALUE_TYPE value_t;
+#endif
+
+// key 배열을 오름차순으로 정렬한다 (rbtree_sort.c의 radix sort). 모든 엔진의
+// rbtree_from_array와 batch 연산이 쓴다
+void rbtree_sort_keys(key_t *arr, const size_t n);
+// key를 대소 순서가 같은 부호 없는 정수로 바꾼다 (radix sort의 자리와 shard 라우팅에 쓴다)
+uint64_t rbtree_key_bits(key_t key);
+
+// -DRBTREE_MULTISET: 같은 key를 노드 하나에 모으고 개수(count)만 센다.
+// 있는 key를 insert하면 count가 늘고 erase는 count를 줄이며, 0이 되면 노드를 지운다.
+// rbtree_to_array는 key를 count번 반복해 채우므로 출력은 기본 모드와 같다.
+// 노드를 순회하는 함수(next/prev, cursor, range, find_batch)는 key마다 한 번씩 방문한다.
+// rbtree_insert_value로 있는 key를 넣으면 value를 새 값으로 바꾼다.
+
+// -DRBTREE_ORDER_STAT: 노드마다 서브트리 크기를 두어 rank/select를 O(log n)에 지원
+// -DRBTREE_INTERVAL: 노드가 key를 시작점으로 하는 닫힌 구간 [key, hi]를 저장하고 서브트리의
+// 가장 큰 hi를 두어 겹치는 구간을 찾는다. key만 받는 함수로 넣은 노드는 [key, key]가 된다.
+#if defined(RBTREE_ORDER_STAT) || defined(RBTREE_INTERVAL)
+#define RBTREE_AUGMENTED
+#endif
+#if defined(RBTREE_INTERVAL) && defined(RBTREE_MULTISET)
+#error "RBTREE_INTERVAL cannot be combined with RBTREE_MULTISET"
+#endif
+
+// -DRBTREE_STATS: 회전, fixup 반복, find 비교 횟수를 트리마다 세고 rbtree_stats로 읽는다.
+// 같은 지점에 USDT probe(provider rbtree, <sys/sdt.h>가 있을 때)와 rbtree_set_trace로
+// 등록한 콜백을 건다. 끄면 계측 코드는 모두 컴파일되지 않는다.
+
+// -DRBTREE_FAT: 같은 API를 레드블랙 트리 대신 fat node(B+ 트리) 엔진으로 구현한다
+// -DRBTREE_TOPDOWN: parent 없이 한 번 내려가며 균형을 맞추는 top-down 레드블랙 트리 엔진
+#ifdef RBTREE_FAT
+#include "fatree.h"
+#elif defined(RBTREE_TOPDOWN)
+#include "tdtree.h"
+#else
 
 typedef struct node_t {
   color_t color;
   key_t key;
   struct node_t *parent, *left, *right;
+#ifdef RBTREE_VALUE_TYPE
+  value_t value;
+#endif
+#ifdef RBTREE_MULTISET
+  size_t count;  // 이 key가 들어간 횟수
+#endif
+#ifdef RBTREE_ORDER_STAT
+  size_t size;  // 이 노드를 루트로 하는 서브트리의 노드 수 (nil은 0). MULTISET이면 count의 합
+#endif
+#ifdef RBTREE_INTERVAL
+  key_t hi;      // 구간의 끝 (key <= hi)
+  key_t max_hi;  // 이 노드를 루트로 하는 서브트리의 hi 중 가장 큰 값
+#endif
 } node_t;
 
+// 노드를 한꺼번에 잡아 두는 slab. 가장 최근 slab이 리스트 맨 앞에 온다.
+typedef struct node_slab_t {
+  struct node_slab_t *next;
+  size_t cap;
+  node_t nodes[];
+} node_slab_t;
+
+// 노드 풀. 새 트리는 자기 풀을 갖고, split으로 나뉜 트리들은 풀을 공유한다.
+// join으로 두 풀이 합쳐지면 흡수된 풀은 forward로 살아남은 풀을 가리킨다.
+// 같은 풀을 쓰는 트리들을 여러 스레드에서 동시에 고치면 안 된다.
+typedef struct node_pool_t {
+  node_slab_t *slabs;
+  node_slab_t *last_slab;  // 가장 오래된 slab (풀 병합 때 O(1)로 잇기 위해)
+  size_t used;             // 맨 앞 slab에서 이미 꺼내 쓴 노드 수
+  node_t *free_list;       // 반환된 노드들 (right 포인터로 연결)
+  node_t *free_tail;
+  int refs;                // 이 풀을 가리키는 트리와 풀의 수
+  struct node_pool_t *forward;
+} node_pool_t;
+
+#ifdef RBTREE_STATS
+// 앞의 카운터는 트리가 만들어진 뒤 누적된 값이다 (split/join과 집합 연산이 임시 트리에서
+// 한 회전과 fixup은 빠진다). 나머지는 rbtree_stats를 부를 때 트리를 훑어 계산한다.
+typedef struct {
+  uint64_t rotations;      // left_rotate, right_rotate 호출 수
+  uint64_t insert_fixups;  // insert_fixup 루프 반복 수
+  uint64_t erase_fixups;   // erase_fixup 루프 반복 수
+  uint64_t finds;          // rbtree_find 호출 수
+  uint64_t find_compares;  // rbtree_find가 key를 비교한 노드 수
+  size_t height;           // 루트부터 가장 깊은 노드까지의 노드 수
+  int black_height;
+  size_t nodes;
+  size_t bytes;            // 노드 풀이 잡아 둔 메모리 (풀을 공유하는 트리들 전체)
+} rbtree_stats_t;
+
+typedef enum {
+  RBTREE_EV_INSERT,  // node: 넣은 노드
+  RBTREE_EV_ERASE,   // node: 지울 노드 (아직 트리에 있다)
+  RBTREE_EV_ROTATE,  // node: 회전 축, arg: 0이면 왼쪽, 1이면 오른쪽
+  RBTREE_EV_FIND,    // node: 찾은 노드 또는 nil, arg: 비교한 노드 수
+  RBTREE_EV_SLAB,    // node: NULL, arg: 새 slab의 바이트 수
+} rbtree_event_t;
+#endif
+
+// 모든 트리는 읽기 전용 sentinel 하나를 공유한다 (서브트리를 트리 사이에서 옮길 수 있도록)
+// size, leftmost, rightmost는 insert/erase가 갱신해 rbtree_size/min/max를 O(1)로 만든다.
+// split과 집합 연산은 결과의 크기를 바로 알 수 없으면 RBTREE_SIZE_UNKNOWN으로 두고,
+// 다음 rbtree_size가 한 번 세어 채운다 (RBTREE_ORDER_STAT이면 루트의 size로 바로 안다).
+// 그래서 그 첫 rbtree_size는 const 트리라도 size를 쓴다. 같은 값을 원자적으로 쓰므로 여러
+// 스레드가 함께 읽기만 하는 트리에서 동시에 불러도 된다.
 typedef struct {
   node_t *root;
   node_t *nil;  // for sentinel
+  node_pool_t *pool;
+  size_t size;        // key 수 (MULTISET이면 count의 합)
+  node_t *leftmost;   // 가장 작은 노드. 빈 트리면 nil
+  node_t *rightmost;  // 가장 큰 노드. 빈 트리면 nil
+#ifdef RBTREE_STATS
+  rbtree_stats_t stats;  // 카운터만 쓴다. 읽을 때는 rbtree_stats
+#endif
 } rbtree;
 
+#define RBTREE_SIZE_UNKNOWN SIZE_MAX
+
+// 중위 순회용 커서. node가 tree->nil이면 끝에 도달한 상태
+typedef struct {
+  const rbtree *tree;
+  node_t *node;
+} rbtree_cursor;
+
+// rbtree_range 콜백. 0이 아닌 값을 반환하면 순회를 멈춘다
+typedef int (*rbtree_range_fn)(node_t *node, void *ctx);
+
+#ifdef RBTREE_STATS
+// rbtree_set_trace 콜백
+typedef void (*rbtree_trace_fn)(rbtree_event_t ev, const rbtree *t, const node_t *node,
+                                uint64_t arg, void *ctx);
+#endif
+
 rbtree *new_rbtree(void);
 void delete_rbtree(rbtree *t);
-void delete_node(node_t *node, node_t *nil);
+void delete_node(rbtree *t, node_t *node);
+
+node_pool_t *tree_pool(rbtree *t);
+void share_pool(rbtree *t1, rbtree *t2);
+node_t *alloc_node(rbtree *t);
+void free_node(rbtree *t, node_t *node);
+node_slab_t *add_slab(rbtree *t, size_t cap);
 
 void left_rotate(rbtree *t, node_t *axis);
 void right_rotate(rbtree *t, node_t *axis);
@@ -29,16 +175,100 @@ void color_swap(rbtree *t, node_t * node);
 
 void insert_fixup(rbtree *t, node_t *node);
 node_t *rbtree_insert(rbtree *t, const key_t);
+#ifdef RBTREE_VALUE_TYPE
+node_t *rbtree_insert_value(rbtree *t, const key_t key, const value_t value);
+#endif
 
 node_t *rbtree_find(const rbtree *, const key_t);
+size_t rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out);
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key);
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key);
+size_t rbtree_range(const rbtree *t, const key_t lo, const key_t hi,
+                    rbtree_range_fn callback, void *ctx);
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
+size_t rbtree_size(const rbtree *t);
+void reset_bounds(rbtree *t);
 
 void transplant(rbtree *t, node_t *u, node_t *v);
-void erase_fixup(rbtree *t, node_t *p);
+void erase_fixup(rbtree *t, node_t *x, node_t *parent);
+void unlink_node(rbtree *t, node_t *p);
 int rbtree_erase(rbtree *t, node_t *p);
 
+// keys를 정렬한 뒤 한꺼번에 반영한다. batch가 트리에 비해 작으면 정렬된 순서로 하나씩,
+// 크면 트리를 key 순서로 훑으며 batch와 합친 뒤 있던 노드를 그대로 써서 트리를 다시 짓는다.
+// 다시 짓는 경로는 회전이 없고 key마다 trace 이벤트를 내지 않는다.
+// insert는 넣은 key 수(노드를 잡지 못하면 n보다 작다)를, erase는 지운 key 수를 반환한다
+// (batch의 key 하나가 같은 key 하나를 지우며, 없는 key는 건너뛴다)
+size_t rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n);
+size_t rbtree_erase_batch(rbtree *t, const key_t *keys, const size_t n);
+
+node_t *rbtree_next(const rbtree *t, const node_t *node);
+node_t *rbtree_prev(const rbtree *t, const node_t *node);
+
+rbtree_cursor rbtree_cursor_first(const rbtree *t);
+rbtree_cursor rbtree_cursor_last(const rbtree *t);
+int rbtree_cursor_valid(const rbtree_cursor *c);
+node_t *rbtree_cursor_next(rbtree_cursor *c);
+node_t *rbtree_cursor_prev(rbtree_cursor *c);
+
+int black_height(const rbtree *t, const node_t *node);
+node_t *join_nodes(rbtree *t, node_t *l, int bhl, node_t *x, node_t *r, int bhr, int *bh);
+void split_nodes(rbtree *t, node_t *node, int bh, const key_t key, const int equal_left,
+                 node_t **l, int *bhl, node_t **r, int *bhr);
+rbtree *rbtree_join(rbtree *t1, const key_t key, rbtree *t2);
+int rbtree_split(rbtree *t, const key_t key, rbtree **lo, rbtree **hi);
+
+// 집합 연산 (rbtree_setops.c). 두 트리를 모두 소비하고 결과 트리(t1)를 반환한다.
+// 두 트리 사이에서는 key를 집합으로 다룬다. 한 트리 안의 같은 key 노드는 그대로 둔다.
+// - union: 양쪽에 있는 key는 한쪽 트리의 노드만 남긴다 (어느 쪽인지는 정하지 않는다).
+//   두 트리가 집합이면 key마다 한 번씩 나온다. MULTISET이면 count는 두 count 중 큰 값이다
+// - intersect: t1의 노드 중 key가 t2에 있는 것을 모두 남긴다 (MULTISET이면 t1의 count 그대로)
+// - difference: t1의 노드 중 key가 t2에 없는 것을 모두 남긴다
+// 큰 트리는 위쪽 재귀를 코어 수만큼 스레드로 나눈다. 환경 변수 RBTREE_SETOP_THREADS로 그 수를 바꿀 수 있다.
+rbtree *rbtree_union(rbtree *t1, rbtree *t2);
+rbtree *rbtree_intersect(rbtree *t1, rbtree *t2);
+rbtree *rbtree_difference(rbtree *t1, rbtree *t2);
+
+#ifdef RBTREE_ORDER_STAT
+node_t *rbtree_select(const rbtree *t, size_t k);
+size_t rbtree_rank(const rbtree *t, const key_t key);
+#endif
+
+#ifdef RBTREE_INTERVAL
+// [lo, hi] 구간을 넣는다. lo가 key가 되며 hi < lo면 NULL
+node_t *rbtree_insert_interval(rbtree *t, const key_t lo, const key_t hi);
+// [lo, hi]와 겹치는 구간 중 시작점이 가장 작은 노드. 없으면 nil. O(log n)
+node_t *rbtree_overlap_first(const rbtree *t, const key_t lo, const key_t hi);
+// [lo, hi]와 겹치는 노드를 key 순서대로 callback에 넘긴다. callback이 0이 아닌 값을
+// 반환하면 멈추며, 넘긴 노드 수를 반환한다. 겹치지 않는 서브트리는 max_hi로 건너뛴다
+size_t rbtree_overlap_all(const rbtree *t, const key_t lo, const key_t hi,
+                          rbtree_range_fn callback, void *ctx);
+#endif
+
+#ifdef RBTREE_STATS
+rbtree_stats_t rbtree_stats(const rbtree *t);
+// 모든 트리에 걸리는 콜백. 다른 스레드가 트리를 쓰기 전에 설정해야 한다 (NULL이면 끈다)
+void rbtree_set_trace(rbtree_trace_fn fn, void *ctx);
+#endif
+
 void inorder_fill(node_t *node, node_t *nil, key_t *arr, int *idx, const size_t n);
 int rbtree_to_array(const rbtree *t, key_t *arr, const size_t);
 
+node_t *build_sorted(rbtree *t, node_t *nodes, const key_t *arr, size_t lo, size_t hi,
+                     node_t *parent, int depth, int red_depth);
+rbtree *rbtree_from_sorted_array(const key_t *arr, const size_t n);
+rbtree *rbtree_from_array(const key_t *arr, const size_t n);
+
+#endif  // RBTREE_FAT, RBTREE_TOPDOWN
+
+// 엔진마다 다른 batch 반영 경로. 정렬된 keys로 트리를 한 번에 다시 짓고 반영한 key 수를
+// *done에 채운다. 하지 않기로 했거나 실패하면 트리를 건드리지 않고 -1을 반환한다
+typedef int (*rbtree_batch_rebuild)(rbtree *t, const key_t *sorted, size_t n, size_t *done);
+
+// 모든 엔진의 insert/erase batch가 쓰는 뼈대 (rbtree_sort.c). keys를 정렬한 복사본을 rebuild에
+// 넘기고, rebuild가 NULL이거나 -1이면 정렬된 순서로(복사본을 잡지 못하면 keys 그대로) 하나씩 반영한다
+size_t rbtree_batch_apply(rbtree *t, const key_t *keys, const size_t n, int erase,
+                          rbtree_batch_rebuild rebuild);
+
 #endif  // _RBTREE_H_
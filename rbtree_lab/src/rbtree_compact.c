@@ -0,0 +1,441 @@
+#include "rbtree_compact.h"
+#include <stdlib.h>
+
+#define COMPACT_MIN_CAP 64
+// parent 인덱스를 31비트에 담으므로 노드 수는 2^31개 미만
+#define COMPACT_MAX_CAP ((uint32_t)1 << 31)
+
+#define NODE(i) (t->nodes[(i)])
+
+static inline void set_parent(compact_rbtree *t, cnode_id i, cnode_id parent) {
+  NODE(i).parent_color = (parent << 1) | (NODE(i).parent_color & 1);
+}
+
+static inline void set_color(compact_rbtree *t, cnode_id i, color_t color) {
+  NODE(i).parent_color = (NODE(i).parent_color & ~(uint32_t)1) | (uint32_t)color;
+}
+
+compact_rbtree *new_compact_rbtree(void) {
+  compact_rbtree *t = calloc(1, sizeof(*t));
+  if (!t) return NULL;
+
+  t->nodes = malloc(COMPACT_MIN_CAP * sizeof(compact_node_t));
+  if (!t->nodes) {
+    free(t); return NULL;
+  }
+  t->cap  = COMPACT_MIN_CAP;
+  t->used = 1;
+
+  // 0번 노드를 nil로 사용
+  NODE(COMPACT_NIL).key = 0;
+  NODE(COMPACT_NIL).parent_color = RBTREE_BLACK;
+  NODE(COMPACT_NIL).left = NODE(COMPACT_NIL).right = COMPACT_NIL;
+
+  t->root = COMPACT_NIL;
+  t->free_list = COMPACT_NIL;
+  return t;
+}
+
+void delete_compact_rbtree(compact_rbtree *t) {
+  if (t == NULL) return;
+
+  free(t->nodes);
+  free(t);
+}
+
+// 노드 배열에서 인덱스 하나를 꺼낸다. 배열이 차면 두 배로 늘리므로
+// 호출 뒤에는 nodes 포인터가 바뀔 수 있다 (인덱스는 그대로 유효).
+static cnode_id compact_alloc(compact_rbtree *t) {
+  if (t->free_list != COMPACT_NIL) {
+    cnode_id id = t->free_list;
+    t->free_list = NODE(id).left;
+    return id;
+  }
+
+  if (t->used == t->cap) {
+    if (t->cap >= COMPACT_MAX_CAP / 2) return COMPACT_NIL;
+    compact_node_t *nodes = realloc(t->nodes, (size_t)t->cap * 2 * sizeof(compact_node_t));
+    if (!nodes) return COMPACT_NIL;
+    t->nodes = nodes;
+    t->cap *= 2;
+  }
+  return t->used++;
+}
+
+static void compact_free(compact_rbtree *t, cnode_id id) {
+  NODE(id).left = t->free_list;
+  t->free_list = id;
+}
+
+void compact_left_rotate(compact_rbtree *t, cnode_id axis) {
+  cnode_id new_parent = NODE(axis).right;
+  cnode_id remain_child = NODE(new_parent).left;
+  cnode_id axis_parent = compact_parent(t, axis);
+
+  // 축 부모 노드의 자식 포인터 변경
+  if (axis_parent == COMPACT_NIL) {
+    t->root = new_parent;
+  } else if (NODE(axis_parent).left == axis) {
+    NODE(axis_parent).left = new_parent;
+  } else {
+    NODE(axis_parent).right = new_parent;
+  }
+
+  // 자식 재배치
+  NODE(new_parent).left = axis;
+  set_parent(t, new_parent, axis_parent);
+  set_parent(t, axis, new_parent);
+
+  // 축의 오른쪽 자식 포인터 재설정
+  NODE(axis).right = remain_child;
+  if (remain_child != COMPACT_NIL) {
+    set_parent(t, remain_child, axis);
+  }
+}
+
+void compact_right_rotate(compact_rbtree *t, cnode_id axis) {
+  cnode_id new_parent = NODE(axis).left;
+  cnode_id remain_child = NODE(new_parent).right;
+  cnode_id axis_parent = compact_parent(t, axis);
+
+  // 축 부모 노드의 자식 포인터 변경
+  if (axis_parent == COMPACT_NIL) {
+    t->root = new_parent;
+  } else if (NODE(axis_parent).left == axis) {
+    NODE(axis_parent).left = new_parent;
+  } else {
+    NODE(axis_parent).right = new_parent;
+  }
+
+  // 자식 재배치
+  NODE(new_parent).right = axis;
+  set_parent(t, new_parent, axis_parent);
+  set_parent(t, axis, new_parent);
+
+  // 축의 왼쪽 자식 포인터 재설정
+  NODE(axis).left = remain_child;
+  if (remain_child != COMPACT_NIL) {
+    set_parent(t, remain_child, axis);
+  }
+}
+
+void compact_insert_fixup(compact_rbtree *t, cnode_id node) {
+  cnode_id cur = node;
+
+  while (compact_parent(t, cur) != COMPACT_NIL &&
+         compact_color(t, compact_parent(t, cur)) == RBTREE_RED) {
+    cnode_id parent = compact_parent(t, cur);
+    cnode_id grandparent = compact_parent(t, parent);
+    if (grandparent == COMPACT_NIL) break;
+
+    // 부모가 할아버지의 왼쪽 자식인 경우
+    if (parent == NODE(grandparent).left) {
+      cnode_id uncle = NODE(grandparent).right;
+
+      // Case 1: 삼촌이 RED
+      if (compact_color(t, uncle) == RBTREE_RED) {
+        set_color(t, parent, RBTREE_BLACK);
+        set_color(t, uncle, RBTREE_BLACK);
+        set_color(t, grandparent, RBTREE_RED);
+        cur = grandparent;
+        continue;
+      }
+
+      // Case 2: 삼촌이 BLACK이고 현재 노드가 부모의 오른쪽 자식
+      if (cur == NODE(parent).right) {
+        cur = parent;
+        compact_left_rotate(t, cur);
+        parent = compact_parent(t, cur);
+      }
+
+      // Case 3: 삼촌이 BLACK이고 현재 노드가 부모의 왼쪽 자식
+      set_color(t, parent, RBTREE_BLACK);
+      set_color(t, grandparent, RBTREE_RED);
+      compact_right_rotate(t, grandparent);
+    }
+    // 부모가 할아버지의 오른쪽 자식인 경우 (대칭)
+    else {
+      cnode_id uncle = NODE(grandparent).left;
+
+      // Case 1: 삼촌이 RED
+      if (compact_color(t, uncle) == RBTREE_RED) {
+        set_color(t, parent, RBTREE_BLACK);
+        set_color(t, uncle, RBTREE_BLACK);
+        set_color(t, grandparent, RBTREE_RED);
+        cur = grandparent;
+        continue;
+      }
+
+      // Case 2: 삼촌이 BLACK이고 현재 노드가 부모의 왼쪽 자식
+      if (cur == NODE(parent).left) {
+        cur = parent;
+        compact_right_rotate(t, cur);
+        parent = compact_parent(t, cur);
+      }
+
+      // Case 3: 삼촌이 BLACK이고 현재 노드가 부모의 오른쪽 자식
+      set_color(t, parent, RBTREE_BLACK);
+      set_color(t, grandparent, RBTREE_RED);
+      compact_left_rotate(t, grandparent);
+    }
+  }
+
+  // 언제나 루트는 BLACK
+  set_color(t, t->root, RBTREE_BLACK);
+}
+
+cnode_id compact_rbtree_insert(compact_rbtree *t, const key_t key) {
+  if (t == NULL) return COMPACT_NIL;
+
+  cnode_id new_node = compact_alloc(t);
+  if (new_node == COMPACT_NIL) return COMPACT_NIL;
+
+  cnode_id parent = COMPACT_NIL;
+  cnode_id cur = t->root;
+  while (cur != COMPACT_NIL) {
+    parent = cur;
+    if (key < NODE(cur).key) {
+      cur = NODE(cur).left;
+    } else {
+      cur = NODE(cur).right;
+    }
+  }
+
+  NODE(new_node).key = key;
+  NODE(new_node).parent_color = (parent << 1) | RBTREE_RED;
+  NODE(new_node).left = COMPACT_NIL;
+  NODE(new_node).right = COMPACT_NIL;
+
+  if (parent == COMPACT_NIL) {
+    t->root = new_node;
+  } else if (key < NODE(parent).key) {
+    NODE(parent).left = new_node;
+  } else {
+    NODE(parent).right = new_node;
+  }
+
+  compact_insert_fixup(t, new_node);
+  return new_node;
+}
+
+cnode_id compact_rbtree_find(const compact_rbtree *t, const key_t key) {
+  cnode_id cur = t->root;
+  while (cur != COMPACT_NIL) {
+    if (key == NODE(cur).key) {
+      return cur;
+    } else if (key < NODE(cur).key) {
+      cur = NODE(cur).left;
+    } else {
+      cur = NODE(cur).right;
+    }
+  }
+  return COMPACT_NIL;
+}
+
+cnode_id compact_rbtree_min(const compact_rbtree *t) {
+  cnode_id cur = t->root;
+  while (NODE(cur).left != COMPACT_NIL) {
+    cur = NODE(cur).left;
+  }
+  return cur;
+}
+
+cnode_id compact_rbtree_max(const compact_rbtree *t) {
+  cnode_id cur = t->root;
+  while (NODE(cur).right != COMPACT_NIL) {
+    cur = NODE(cur).right;
+  }
+  return cur;
+}
+
+// key 이상인 첫 노드. 없으면 COMPACT_NIL
+cnode_id compact_rbtree_lower_bound(const compact_rbtree *t, const key_t key) {
+  cnode_id found = COMPACT_NIL;
+  cnode_id cur = t->root;
+  while (cur != COMPACT_NIL) {
+    if (NODE(cur).key < key) {
+      cur = NODE(cur).right;
+    } else {
+      found = cur;
+      cur = NODE(cur).left;
+    }
+  }
+  return found;
+}
+
+// 중위 순회 기준 다음 노드. 마지막 노드였으면 COMPACT_NIL
+cnode_id compact_rbtree_next(const compact_rbtree *t, cnode_id i) {
+  if (i == COMPACT_NIL) return COMPACT_NIL;
+
+  if (NODE(i).right != COMPACT_NIL) {
+    cnode_id cur = NODE(i).right;
+    while (NODE(cur).left != COMPACT_NIL) {
+      cur = NODE(cur).left;
+    }
+    return cur;
+  }
+
+  cnode_id parent = compact_parent(t, i);
+  while (parent != COMPACT_NIL && i == NODE(parent).right) {
+    i = parent;
+    parent = compact_parent(t, parent);
+  }
+  return parent;
+}
+
+// 부모-자식 링크를 v로 대체
+void compact_transplant(compact_rbtree *t, cnode_id u, cnode_id v) {
+  cnode_id u_parent = compact_parent(t, u);
+  if (u_parent == COMPACT_NIL)
+    t->root = v;
+  else if (u == NODE(u_parent).left)
+    NODE(u_parent).left = v;
+  else
+    NODE(u_parent).right = v;
+
+  // nil의 parent도 기록해 두어야 erase_fixup이 올바른 위치에서 시작한다
+  set_parent(t, v, u_parent);
+}
+
+void compact_erase_fixup(compact_rbtree *t, cnode_id x) {
+  while (x != t->root && compact_color(t, x) == RBTREE_BLACK) {
+    cnode_id parent = compact_parent(t, x);
+    if (x == NODE(parent).left) {
+      cnode_id w = NODE(parent).right;
+      // Case 1: 형제가 RED
+      if (compact_color(t, w) == RBTREE_RED) {
+        set_color(t, w, RBTREE_BLACK);
+        set_color(t, parent, RBTREE_RED);
+        compact_left_rotate(t, parent);
+        w = NODE(parent).right;
+      }
+      // Case 2: 형제의 양쪽 자식이 모두 BLACK
+      if (compact_color(t, NODE(w).left) == RBTREE_BLACK &&
+          compact_color(t, NODE(w).right) == RBTREE_BLACK) {
+        set_color(t, w, RBTREE_RED);
+        x = parent;
+      } else {
+        // Case 3: 형제의 오른쪽 자식이 BLACK
+        if (compact_color(t, NODE(w).right) == RBTREE_BLACK) {
+          set_color(t, NODE(w).left, RBTREE_BLACK);
+          set_color(t, w, RBTREE_RED);
+          compact_right_rotate(t, w);
+          w = NODE(parent).right;
+        }
+        // Case 4: 형제의 오른쪽 자식이 RED
+        set_color(t, w, compact_color(t, parent));
+        set_color(t, parent, RBTREE_BLACK);
+        set_color(t, NODE(w).right, RBTREE_BLACK);
+        compact_left_rotate(t, parent);
+        x = t->root;
+      }
+    } else {
+      // x가 오른쪽 자식인 경우: 왼쪽 형제에 대해 대칭 처리
+      cnode_id w = NODE(parent).left;
+      // Case 1: 형제가 RED
+      if (compact_color(t, w) == RBTREE_RED) {
+        set_color(t, w, RBTREE_BLACK);
+        set_color(t, parent, RBTREE_RED);
+        compact_right_rotate(t, parent);
+        w = NODE(parent).left;
+      }
+      // Case 2: 형제의 양쪽 자식이 모두 BLACK
+      if (compact_color(t, NODE(w).left) == RBTREE_BLACK &&
+          compact_color(t, NODE(w).right) == RBTREE_BLACK) {
+        set_color(t, w, RBTREE_RED);
+        x = parent;
+      } else {
+        // Case 3: 형제의 왼쪽 자식이 BLACK
+        if (compact_color(t, NODE(w).left) == RBTREE_BLACK) {
+          set_color(t, NODE(w).right, RBTREE_BLACK);
+          set_color(t, w, RBTREE_RED);
+          compact_left_rotate(t, w);
+          w = NODE(parent).left;
+        }
+        // Case 4: 형제의 왼쪽 자식이 RED
+        set_color(t, w, compact_color(t, parent));
+        set_color(t, parent, RBTREE_BLACK);
+        set_color(t, NODE(w).left, RBTREE_BLACK);
+        compact_right_rotate(t, parent);
+        x = t->root;
+      }
+    }
+  }
+  // 마지막으로 x를 BLACK으로
+  set_color(t, x, RBTREE_BLACK);
+}
+
+int compact_rbtree_erase(compact_rbtree *t, cnode_id p) {
+  if (!t || p == COMPACT_NIL || p >= t->used) return -1;
+
+  cnode_id y = p;  // 트리에서 제거될 노드
+  cnode_id x;      // y의 자리를 대체할 노드
+  color_t y_original_color = compact_color(t, y);
+
+  if (NODE(p).left == COMPACT_NIL) {
+    x = NODE(p).right;
+    compact_transplant(t, p, x);
+  } else if (NODE(p).right == COMPACT_NIL) {
+    x = NODE(p).left;
+    compact_transplant(t, p, x);
+  } else {
+    y = NODE(p).right;
+    while (NODE(y).left != COMPACT_NIL) {
+      y = NODE(y).left;
+    }
+
+    y_original_color = compact_color(t, y);
+    x = NODE(y).right;
+
+    if (compact_parent(t, y) == p) {
+      set_parent(t, x, y);
+    } else {
+      compact_transplant(t, y, x);
+      NODE(y).right = NODE(p).right;
+      set_parent(t, NODE(y).right, y);
+    }
+
+    compact_transplant(t, p, y);
+    NODE(y).left = NODE(p).left;
+    set_parent(t, NODE(y).left, y);
+    set_color(t, y, compact_color(t, p));
+  }
+
+  if (y_original_color == RBTREE_BLACK) {
+    compact_erase_fixup(t, x);
+  }
+
+  compact_free(t, p);
+  return 0;
+}
+
+int compact_rbtree_to_array(const compact_rbtree *t, key_t *arr, const size_t n) {
+  if (t == NULL) return -1;
+
+  // parent 링크를 따라 중위 순회
+  int idx = 0;
+  cnode_id cur = t->root;
+  if (cur == COMPACT_NIL) return 0;
+  while (NODE(cur).left != COMPACT_NIL) {
+    cur = NODE(cur).left;
+  }
+
+  while (cur != COMPACT_NIL && idx < n) {
+    arr[idx++] = NODE(cur).key;
+
+    if (NODE(cur).right != COMPACT_NIL) {
+      cur = NODE(cur).right;
+      while (NODE(cur).left != COMPACT_NIL) {
+        cur = NODE(cur).left;
+      }
+    } else {
+      cnode_id parent = compact_parent(t, cur);
+      while (parent != COMPACT_NIL && cur == NODE(parent).right) {
+        cur = parent;
+        parent = compact_parent(t, parent);
+      }
+      cur = parent;
+    }
+  }
+  return idx;
+}
@@ -0,0 +1,56 @@
+#ifndef _RBTREE_COMPACT_H_
+#define _RBTREE_COMPACT_H_
+
+#include "rbtree.h"
+
+// 포인터 대신 32비트 인덱스로 연결하는 compact 레이아웃.
+// 노드는 트리가 가진 배열 하나에 모여 있고, 0번 노드가 sentinel(nil)이다.
+// 색은 parent 링크의 최하위 비트에 넣으므로 int key 기준 노드 하나가 16바이트다.
+typedef uint32_t cnode_id;
+
+typedef struct {
+  key_t key;
+  uint32_t parent_color;  // (parent 인덱스 << 1) | color
+  cnode_id left, right;
+} compact_node_t;
+
+typedef struct {
+  compact_node_t *nodes;  // nodes[0]은 nil
+  cnode_id root;
+  uint32_t cap;           // nodes 배열 크기
+  uint32_t used;          // 한 번이라도 할당된 노드 수 (nil 포함)
+  cnode_id free_list;     // 반환된 노드들 (left 인덱스로 연결)
+} compact_rbtree;
+
+#define COMPACT_NIL ((cnode_id)0)
+
+compact_rbtree *new_compact_rbtree(void);
+void delete_compact_rbtree(compact_rbtree *t);
+
+void compact_left_rotate(compact_rbtree *t, cnode_id axis);
+void compact_right_rotate(compact_rbtree *t, cnode_id axis);
+
+void compact_insert_fixup(compact_rbtree *t, cnode_id node);
+cnode_id compact_rbtree_insert(compact_rbtree *t, const key_t key);
+
+cnode_id compact_rbtree_find(const compact_rbtree *t, const key_t key);
+cnode_id compact_rbtree_min(const compact_rbtree *t);
+cnode_id compact_rbtree_max(const compact_rbtree *t);
+cnode_id compact_rbtree_lower_bound(const compact_rbtree *t, const key_t key);
+cnode_id compact_rbtree_next(const compact_rbtree *t, cnode_id i);
+
+void compact_transplant(compact_rbtree *t, cnode_id u, cnode_id v);
+void compact_erase_fixup(compact_rbtree *t, cnode_id x);
+int compact_rbtree_erase(compact_rbtree *t, cnode_id p);
+
+int compact_rbtree_to_array(const compact_rbtree *t, key_t *arr, const size_t n);
+
+static inline cnode_id compact_parent(const compact_rbtree *t, cnode_id i) {
+  return t->nodes[i].parent_color >> 1;
+}
+
+static inline color_t compact_color(const compact_rbtree *t, cnode_id i) {
+  return (color_t)(t->nodes[i].parent_color & 1);
+}
+
+#endif  // _RBTREE_COMPACT_H_
@@ -0,0 +1,158 @@
+#include "rbtree_concurrent.h"
+#include <stdlib.h>
+#include <string.h>
+
+// 스레드마다 처음 읽을 때 stripe 하나를 차례로 맡는다 (모든 트리에서 같은 칸을 쓴다)
+static atomic_int next_stripe;
+static _Thread_local int my_stripe = -1;
+
+concurrent_rbtree *new_concurrent_rbtree(void) {
+  // stripe끼리 캐시 라인을 나눠 쓰지 않도록 64바이트 경계에 잡는다
+  concurrent_rbtree *ct = aligned_alloc(64, sizeof(*ct));
+  if (!ct) return NULL;
+  memset(ct, 0, sizeof(*ct));
+
+  ct->tree = new_rbtree();
+  if (!ct->tree) {
+    free(ct); return NULL;
+  }
+  pthread_mutex_init(&ct->write_lock, NULL);
+  atomic_init(&ct->seq, 0);
+  atomic_init(&ct->epoch, 0);
+  for (int i = 0; i < EPOCH_STRIPES; i++) {
+    atomic_init(&ct->stripes[i].active[0], 0);
+    atomic_init(&ct->stripes[i].active[1], 0);
+  }
+  return ct;
+}
+
+void delete_concurrent_rbtree(concurrent_rbtree *ct) {
+  if (ct == NULL) return;
+
+  pthread_mutex_destroy(&ct->write_lock);
+  delete_rbtree(ct->tree);
+  free(ct);
+}
+
+// 지금 epoch의 칸에 들어온 것을 알린다. 알린 뒤에도 epoch가 그대로여야 쓰는 쪽이
+// 그 epoch를 정리할 때 이 reader를 센다 (둘 다 seq_cst라 한쪽은 반드시 상대를 본다)
+static atomic_ulong *epoch_enter(concurrent_rbtree *ct) {
+  if (my_stripe < 0) my_stripe = atomic_fetch_add(&next_stripe, 1) % EPOCH_STRIPES;
+  epoch_stripe *stripe = &ct->stripes[my_stripe];
+
+  while (1) {
+    unsigned long e = atomic_load(&ct->epoch);
+    atomic_ulong *active = &stripe->active[e & 1];
+    atomic_fetch_add(active, 1);
+    if (atomic_load(&ct->epoch) == e) return active;
+    atomic_fetch_sub(active, 1);
+  }
+}
+
+static void epoch_exit(atomic_ulong *active) {
+  atomic_fetch_sub_explicit(active, 1, memory_order_release);
+}
+
+// epoch e-1에 들어온 reader가 모두 나갔으면 e-1에 떼어 낸 노드는 더 이상 아무도 밟고 있지
+// 않다. e 이후에 들어온 reader는 이미 떼어 낸 노드에 닿을 수 없다. 그 노드들을 풀에 돌려주고
+// epoch를 올리면 비운 limbo를 e+1이 이어 쓴다. write_lock을 잡은 채로 부른다.
+static void epoch_reclaim(concurrent_rbtree *ct) {
+  const unsigned long e = atomic_load_explicit(&ct->epoch, memory_order_relaxed);
+  const int prev = (e - 1) & 1;
+  for (int i = 0; i < EPOCH_STRIPES; i++) {
+    if (atomic_load(&ct->stripes[i].active[prev]) != 0) return;
+  }
+
+  node_t *node = ct->limbo[prev];
+  while (node != NULL) {
+    node_t *next = node->parent;
+    free_node(ct->tree, node);
+    node = next;
+  }
+  ct->limbo[prev] = NULL;
+  ct->retired = 0;
+  atomic_store(&ct->epoch, e + 1);
+}
+
+// 떼어 낸 노드의 left/right는 reader가 따라갈 수 있으므로 건드리지 않고 parent로 잇는다
+static void retire(concurrent_rbtree *ct, node_t *node) {
+  const unsigned long e = atomic_load_explicit(&ct->epoch, memory_order_relaxed);
+  node->parent = ct->limbo[e & 1];
+  ct->limbo[e & 1] = node;
+  if (++ct->retired >= EPOCH_BATCH) epoch_reclaim(ct);
+}
+
+// seq를 홀수로 만든 뒤에야 트리를 고치고, 다 고친 뒤 짝수로 되돌린다
+static void write_begin(concurrent_rbtree *ct) {
+  pthread_mutex_lock(&ct->write_lock);
+  unsigned long s = atomic_load_explicit(&ct->seq, memory_order_relaxed);
+  atomic_store_explicit(&ct->seq, s + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(concurrent_rbtree *ct) {
+  unsigned long s = atomic_load_explicit(&ct->seq, memory_order_relaxed);
+  atomic_store_explicit(&ct->seq, s + 1, memory_order_release);
+  pthread_mutex_unlock(&ct->write_lock);
+}
+
+int concurrent_rbtree_insert(concurrent_rbtree *ct, const key_t key) {
+  write_begin(ct);
+  node_t *node = rbtree_insert(ct->tree, key);
+  write_end(ct);
+  return node == NULL ? -1 : 0;
+}
+
+int concurrent_rbtree_erase(concurrent_rbtree *ct, const key_t key) {
+  write_begin(ct);
+  rbtree *t = ct->tree;
+  node_t *p = rbtree_find(t, key);
+  int ret = -1;
+  if (p != t->nil) {
+#ifdef RBTREE_MULTISET
+    if (p->count > 1) {
+      ret = rbtree_erase(t, p);
+      write_end(ct);
+      return ret;
+    }
+#endif
+    unlink_node(t, p);
+    retire(ct, p);
+    ret = 0;
+  }
+  write_end(ct);
+  return ret;
+}
+
+// 락 없이 탐색한다. 찾은 노드는 epoch 안에서 재사용되지 않으므로 탐색 도중 그 key로 트리에
+// 있었던 노드이고, 그대로 인정한다. 못 찾았으면 그 사이에 쓰기가 없었을 때만 인정한다.
+// 회전 도중의 링크를 읽으면 경로가 꼬일 수 있으므로 최대 높이에서 끊고 재시도한다.
+int concurrent_rbtree_contains(concurrent_rbtree *ct, const key_t key) {
+  const rbtree *t = ct->tree;
+  atomic_ulong *active = epoch_enter(ct);
+
+  while (1) {
+    unsigned long s = atomic_load_explicit(&ct->seq, memory_order_acquire);
+    if (s & 1) continue;
+
+    int depth = 0;
+    node_t *cur = __atomic_load_n(&t->root, __ATOMIC_ACQUIRE);
+    while (cur != t->nil && depth++ < RBTREE_MAX_HEIGHT) {
+      key_t cur_key;
+      __atomic_load(&cur->key, &cur_key, __ATOMIC_RELAXED);
+      if (key == cur_key) {
+        epoch_exit(active);
+        return 1;
+      }
+      cur = (key < cur_key) ? __atomic_load_n(&cur->left, __ATOMIC_ACQUIRE)
+                            : __atomic_load_n(&cur->right, __ATOMIC_ACQUIRE);
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (depth <= RBTREE_MAX_HEIGHT &&
+        atomic_load_explicit(&ct->seq, memory_order_relaxed) == s) {
+      epoch_exit(active);
+      return 0;
+    }
+  }
+}
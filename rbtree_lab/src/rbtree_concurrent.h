@@ -0,0 +1,43 @@
+#ifndef _RBTREE_CONCURRENT_H_
+#define _RBTREE_CONCURRENT_H_
+
+#include "rbtree.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// 읽는 스레드가 epoch를 알리는 칸 수. 스레드는 차례로 칸을 하나씩 맡고, 칸이 모자라면 나눠 쓴다
+#define EPOCH_STRIPES 16
+// 떼어 낸 노드가 이만큼 쌓일 때마다 풀에 돌려줄 수 있는지 확인한다
+#define EPOCH_BATCH 64
+
+typedef struct {
+  atomic_ulong active[2];  // 짝수/홀수 epoch에 들어와 있는 reader 수
+} __attribute__((aligned(64))) epoch_stripe;
+
+// 여러 스레드가 함께 쓰는 rbtree 핸들.
+// 쓰기(insert/erase)는 write_lock으로 직렬화하고, 읽기는 락 없이 seqlock으로
+// 검증한다. 읽는 도중 seq가 바뀌었으면 그 결과를 버리고 다시 탐색한다.
+//
+// erase가 떼어 낸 노드는 바로 풀의 free list로 보내지 않고 그때의 epoch에 묶어 둔다.
+// 그 epoch에 들어와 있던 reader가 모두 나가면 한꺼번에 풀에 돌려준다. 그래서 reader가
+// 밟고 있는 노드는 다른 key로 재사용되거나 free list로 링크가 바뀌지 않고, 찾은 key는
+// seq 검증 없이 인정할 수 있다. 못 찾은 결과만 회전과 겹쳤는지 seq로 확인한다.
+typedef struct {
+  rbtree *tree;
+  pthread_mutex_t write_lock;
+  atomic_ulong seq;    // 홀수면 쓰기 진행 중
+  atomic_ulong epoch;
+  epoch_stripe stripes[EPOCH_STRIPES];
+  node_t *limbo[2];    // epoch 짝/홀에 떼어 낸 노드. parent로 잇고 write_lock 아래에서만 고친다
+  size_t retired;      // 마지막 확인 이후 떼어 낸 노드 수
+} concurrent_rbtree;
+
+concurrent_rbtree *new_concurrent_rbtree(void);
+void delete_concurrent_rbtree(concurrent_rbtree *ct);
+
+int concurrent_rbtree_insert(concurrent_rbtree *ct, const key_t key);
+int concurrent_rbtree_erase(concurrent_rbtree *ct, const key_t key);
+
+int concurrent_rbtree_contains(concurrent_rbtree *ct, const key_t key);
+
+#endif  // _RBTREE_CONCURRENT_H_
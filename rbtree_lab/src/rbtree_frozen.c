@@ -0,0 +1,98 @@
+#include "rbtree_frozen.h"
+#include <stdlib.h>
+
+// 캐시 라인 크기(바이트)와 한 라인에 들어가는 key 수 L = 2^d.
+// 위치 k의 d레벨 아래 자손 L개는 L*k부터 이어져 있고 L*k*sizeof(key_t)가 라인 크기의 배수이므로
+// 정확히 한 라인을 채운다. 4바이트 key면 4레벨 아래 16개, 8바이트 key면 3레벨 아래 8개다
+#define FROZEN_LINE 64
+#define FROZEN_PREFETCH (FROZEN_LINE / sizeof(key_t))
+
+// 중위 순회 순서의 노드를 Eytzinger 위치 k에 채운다. 재귀 깊이는 log n이다
+static const node_t *fill(frozen_rbtree *f, const rbtree *t, const node_t *node, size_t k) {
+  if (k > f->n) return node;
+
+  node = fill(f, t, node, 2 * k);
+  f->keys[k] = node->key;
+#ifdef RBTREE_VALUE_TYPE
+  f->values[k] = node->value;
+#endif
+  node = rbtree_next(t, node);
+  return fill(f, t, node, 2 * k + 1);
+}
+
+frozen_rbtree *rbtree_freeze(const rbtree *t) {
+  frozen_rbtree *f = calloc(1, sizeof(*f));
+  if (f == NULL) return NULL;
+
+  for (node_t *p = rbtree_min(t); p != t->nil; p = rbtree_next(t, p)) {
+    f->n++;
+  }
+
+  // 루트(1번)부터 캐시 라인 경계에 맞춘다
+  size_t bytes = (f->n + 1) * sizeof(key_t);
+  bytes = (bytes + FROZEN_LINE - 1) / FROZEN_LINE * FROZEN_LINE;
+  f->keys = aligned_alloc(FROZEN_LINE, bytes);
+#ifdef RBTREE_VALUE_TYPE
+  f->values = malloc((f->n + 1) * sizeof(value_t));
+  if (f->values == NULL) {
+    free(f->keys);
+    f->keys = NULL;
+  }
+#endif
+  if (f->keys == NULL) {
+    free(f);
+    return NULL;
+  }
+
+  fill(f, t, rbtree_min(t), 1);
+  return f;
+}
+
+void delete_frozen_rbtree(frozen_rbtree *f) {
+  if (f == NULL) return;
+
+  free(f->keys);
+#ifdef RBTREE_VALUE_TYPE
+  free(f->values);
+#endif
+  free(f);
+}
+
+// 끝까지 내려가며 key 이상이면 왼쪽(2k), 작으면 오른쪽(2k+1)으로 간다.
+// 마지막으로 왼쪽으로 꺾은 곳이 답이므로, 경로 비트에서 끝의 1들과 그 앞의 0 하나를
+// 떼어 내면 된다. 모두 1이면(전부 오른쪽) 0이 되어 "없음"을 뜻한다.
+size_t frozen_lower_bound(const frozen_rbtree *f, const key_t key) {
+  const key_t *keys = f->keys;
+  size_t k = 1;
+  while (k <= f->n) {
+    __builtin_prefetch(keys + FROZEN_PREFETCH * k);
+    k = 2 * k + (keys[k] < key);
+  }
+  k >>= __builtin_ffsll(~(unsigned long long)k);
+  return k;
+}
+
+size_t frozen_find(const frozen_rbtree *f, const key_t key) {
+  size_t k = frozen_lower_bound(f, key);
+  return (k != 0 && f->keys[k] == key) ? k : 0;
+}
+
+size_t frozen_min(const frozen_rbtree *f) {
+  if (f->n == 0) return 0;
+
+  size_t k = 1;
+  while (2 * k <= f->n) {
+    k = 2 * k;
+  }
+  return k;
+}
+
+size_t frozen_max(const frozen_rbtree *f) {
+  if (f->n == 0) return 0;
+
+  size_t k = 1;
+  while (2 * k + 1 <= f->n) {
+    k = 2 * k + 1;
+  }
+  return k;
+}
@@ -0,0 +1,28 @@
+#ifndef _RBTREE_FROZEN_H_
+#define _RBTREE_FROZEN_H_
+
+#include "rbtree.h"
+
+// 더 이상 바뀌지 않는 트리를 탐색 전용 배열로 굳힌 것.
+// key를 Eytzinger 순서(BFS 순서, 1번이 루트, i의 자식은 2i와 2i+1)로 한 배열에 담는다.
+// 탐색은 비교 결과를 인덱스 계산에 그대로 써서 분기가 없고, 위쪽 레벨은 배열 앞부분에
+// 모여 캐시에 남으며, 몇 레벨 아래의 노드를 미리 prefetch할 수 있다.
+// RBTREE_MULTISET이면 노드마다 한 칸이므로 같은 key는 한 번만 들어간다.
+typedef struct {
+  key_t *keys;      // keys[1..n], keys[0]은 쓰지 않는다
+#ifdef RBTREE_VALUE_TYPE
+  value_t *values;  // keys와 같은 순서
+#endif
+  size_t n;
+} frozen_rbtree;
+
+frozen_rbtree *rbtree_freeze(const rbtree *t);
+void delete_frozen_rbtree(frozen_rbtree *f);
+
+// 결과는 key가 놓인 인덱스 (1..n), 없으면 0
+size_t frozen_find(const frozen_rbtree *f, const key_t key);
+size_t frozen_lower_bound(const frozen_rbtree *f, const key_t key);
+size_t frozen_min(const frozen_rbtree *f);
+size_t frozen_max(const frozen_rbtree *f);
+
+#endif  // _RBTREE_FROZEN_H_
@@ -0,0 +1,343 @@
+#include "rbtree_mmap.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RBTREE_BYTE_ORDER 0x01020304u
+
+#ifndef RBTREE_MULTISET
+// 노드를 레벨 순서로 번호 매겨 compact 노드 배열로 옮긴다.
+// queue[i]는 i번 compact 노드가 될 원래 노드이고, 배열 자체를 BFS 큐로 쓴다.
+static compact_node_t *flatten(const rbtree *t, uint64_t count) {
+  // 구조체의 빈 바이트(8바이트 key의 노드마다 4바이트)까지 정해진 값으로 파일에 쓰도록 0으로 잡는다
+  compact_node_t *out = calloc(count + 1, sizeof(compact_node_t));
+  node_t **queue = malloc((count + 1) * sizeof(node_t *));
+  if (out == NULL || queue == NULL) {
+    free(out);
+    free(queue);
+    return NULL;
+  }
+
+  out[COMPACT_NIL].key = 0;
+  out[COMPACT_NIL].parent_color = RBTREE_BLACK;
+  out[COMPACT_NIL].left = out[COMPACT_NIL].right = COMPACT_NIL;
+
+  uint64_t tail = 1;
+  if (t->root != t->nil) {
+    queue[tail] = t->root;
+    out[tail].parent_color = (COMPACT_NIL << 1) | t->root->color;
+    tail++;
+  }
+
+  for (uint64_t i = 1; i < tail; i++) {
+    const node_t *node = queue[i];
+    out[i].key = node->key;
+    out[i].left = out[i].right = COMPACT_NIL;
+
+    if (node->left != t->nil) {
+      out[i].left = (cnode_id)tail;
+      out[tail].parent_color = ((uint32_t)i << 1) | node->left->color;
+      queue[tail++] = node->left;
+    }
+    if (node->right != t->nil) {
+      out[i].right = (cnode_id)tail;
+      out[tail].parent_color = ((uint32_t)i << 1) | node->right->color;
+      queue[tail++] = node->right;
+    }
+  }
+
+  free(queue);
+  return out;
+}
+#else
+typedef struct {
+  uint64_t lo, hi;
+  int depth;
+} sorted_span;
+
+// compact 노드에는 count를 담을 자리가 없으므로, key를 count번씩 펼친 정렬 배열로
+// build_sorted와 같은 모양의 트리를 만들어 레벨 순서로 번호를 매긴다
+static compact_node_t *flatten_sorted(const key_t *arr, uint64_t count) {
+  compact_node_t *out = calloc(count + 1, sizeof(compact_node_t));
+  sorted_span *queue = malloc((count + 1) * sizeof(sorted_span));
+  if (out == NULL || queue == NULL) {
+    free(out);
+    free(queue);
+    return NULL;
+  }
+
+  out[COMPACT_NIL].key = 0;
+  out[COMPACT_NIL].parent_color = RBTREE_BLACK;
+  out[COMPACT_NIL].left = out[COMPACT_NIL].right = COMPACT_NIL;
+
+  int red_depth = 0;
+  for (uint64_t m = count; m > 1; m >>= 1) {
+    red_depth++;
+  }
+
+  uint64_t tail = 1;
+  if (count > 0) {
+    queue[tail] = (sorted_span){ 0, count, 0 };
+    out[tail].parent_color = (COMPACT_NIL << 1) | RBTREE_BLACK;
+    tail++;
+  }
+
+  for (uint64_t i = 1; i < tail; i++) {
+    const sorted_span span = queue[i];
+    const uint64_t mid = span.lo + (span.hi - span.lo) / 2;
+    const color_t child_color = (span.depth + 1 == red_depth) ? RBTREE_RED : RBTREE_BLACK;
+    out[i].key = arr[mid];
+    out[i].left = out[i].right = COMPACT_NIL;
+
+    if (span.lo < mid) {
+      out[i].left = (cnode_id)tail;
+      out[tail].parent_color = ((uint32_t)i << 1) | child_color;
+      queue[tail++] = (sorted_span){ span.lo, mid, span.depth + 1 };
+    }
+    if (mid + 1 < span.hi) {
+      out[i].right = (cnode_id)tail;
+      out[tail].parent_color = ((uint32_t)i << 1) | child_color;
+      queue[tail++] = (sorted_span){ mid + 1, span.hi, span.depth + 1 };
+    }
+  }
+
+  free(queue);
+  return out;
+}
+#endif
+
+// rename이 디스크에 남도록 파일이 든 디렉터리를 fsync한다
+static int sync_parent_dir(const char *path) {
+  const char *slash = strrchr(path, '/');
+  char *dir = slash == NULL ? strdup(".") : strndup(path, slash == path ? 1 : slash - path);
+  if (dir == NULL) return -1;
+
+  int fd = open(dir, O_RDONLY);
+  free(dir);
+  if (fd < 0) return -1;
+  int ret = fsync(fd);
+  close(fd);
+  return ret;
+}
+
+int rbtree_save(const rbtree *t, const char *path) {
+  return rbtree_save_tagged(t, path, 0);
+}
+
+// 같은 디렉터리의 임시 파일에 쓴 뒤 rename하므로, 실패해도 기존 파일은 그대로 남는다
+int rbtree_save_tagged(const rbtree *t, const char *path, const uint64_t tag) {
+  uint64_t count = rbtree_size(t);
+  // parent 인덱스를 31비트에 담으므로 compact 트리와 같은 한도를 둔다
+  if (count >= ((uint64_t)1 << 31) - 1) return -1;
+
+#ifdef RBTREE_MULTISET
+  compact_node_t *nodes = NULL;
+  key_t *keys = malloc((count > 0 ? count : 1) * sizeof(key_t));
+  if (keys != NULL) {
+    rbtree_to_array(t, keys, count);
+    nodes = flatten_sorted(keys, count);
+    free(keys);
+  }
+#else
+  compact_node_t *nodes = flatten(t, count);
+#endif
+  if (nodes == NULL) return -1;
+
+  rbtree_file_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, RBTREE_FILE_MAGIC, sizeof(h.magic));
+  h.byte_order = RBTREE_BYTE_ORDER;
+  h.key_size = sizeof(key_t);
+  h.node_size = sizeof(compact_node_t);
+  h.root = count > 0 ? 1 : COMPACT_NIL;
+  h.count = count;
+  h.tag = tag;
+
+  size_t len = strlen(path);
+  char *tmp = malloc(len + 5);
+  if (tmp == NULL) {
+    free(nodes);
+    return -1;
+  }
+  memcpy(tmp, path, len);
+  memcpy(tmp + len, ".tmp", 5);
+
+  int ret = -1;
+  FILE *fp = fopen(tmp, "wb");
+  if (fp != NULL) {
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+             fwrite(nodes, sizeof(compact_node_t), count + 1, fp) == count + 1;
+    ok = (fflush(fp) == 0) && ok;
+    ok = (fsync(fileno(fp)) == 0) && ok;
+    ok = (fclose(fp) == 0) && ok;
+    if (ok && rename(tmp, path) == 0) {
+      ret = sync_parent_dir(path);
+    } else {
+      unlink(tmp);
+    }
+  }
+
+  free(tmp);
+  free(nodes);
+  return ret;
+}
+
+// 헤더만 검사하고 노드는 건드리지 않는다. 페이지는 조회할 때 필요한 것만 읽힌다.
+// 노드의 링크는 조회 함수가 따라갈 때 검사한다
+mmap_rbtree *rbtree_open_mmap(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(rbtree_file_header)) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t length = (size_t)st.st_size;
+  void *base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return NULL;
+
+  const rbtree_file_header *h = base;
+  if (memcmp(h->magic, RBTREE_FILE_MAGIC, sizeof(h->magic)) != 0 ||
+      h->byte_order != RBTREE_BYTE_ORDER || h->key_size != sizeof(key_t) ||
+      h->node_size != sizeof(compact_node_t) ||
+      h->count >= ((uint64_t)1 << 31) - 1 ||
+      length != sizeof(*h) + (h->count + 1) * sizeof(compact_node_t) ||
+      h->root > h->count) {
+    munmap(base, length);
+    return NULL;
+  }
+
+  mmap_rbtree *m = calloc(1, sizeof(*m));
+  if (m == NULL) {
+    munmap(base, length);
+    return NULL;
+  }
+  m->base = base;
+  m->length = length;
+  m->tree.nodes = (compact_node_t *)((char *)base + sizeof(*h));
+  m->tree.root = h->root;
+  m->tree.cap = m->tree.used = (uint32_t)(h->count + 1);
+  m->tree.free_list = COMPACT_NIL;
+  m->tag = h->tag;
+  return m;
+}
+
+void rbtree_close_mmap(mmap_rbtree *m) {
+  if (m == NULL) return;
+
+  munmap(m->base, m->length);
+  free(m);
+}
+
+// 파일을 열 때 링크는 검사하지 않았으므로 인덱스는 따라갈 때마다 범위를 확인한다.
+// 범위 밖의 인덱스는 nil로 본다. 손상된 파일의 순환 링크에 갇히지 않도록 내려가는 깊이는
+// RBTREE_MAX_HEIGHT, 순회하는 노드 수는 파일의 노드 수로 제한한다.
+static cnode_id child(const mmap_rbtree *m, cnode_id i, int right) {
+  const cnode_id c = right ? m->tree.nodes[i].right : m->tree.nodes[i].left;
+  return c < m->tree.used ? c : COMPACT_NIL;
+}
+
+// 한쪽 끝까지 내려간 노드. 빈 트리면 NULL
+static const compact_node_t *edge(const mmap_rbtree *m, int right) {
+  cnode_id cur = m->tree.root;
+  if (cur == COMPACT_NIL) return NULL;
+
+  for (int depth = 1; depth < RBTREE_MAX_HEIGHT; depth++) {
+    cnode_id next = child(m, cur, right);
+    if (next == COMPACT_NIL) break;
+    cur = next;
+  }
+  return &m->tree.nodes[cur];
+}
+
+// parent 링크 없이 중위 순회하는 스택. 맨 위가 다음에 방문할 노드다
+typedef struct {
+  cnode_id nodes[RBTREE_MAX_HEIGHT];
+  int top;
+} mmap_iter;
+
+static void push_left(const mmap_rbtree *m, mmap_iter *it, cnode_id cur) {
+  while (cur != COMPACT_NIL && it->top < RBTREE_MAX_HEIGHT) {
+    it->nodes[it->top++] = cur;
+    cur = child(m, cur, 0);
+  }
+}
+
+// lo 이상인 첫 노드부터 순회하도록 스택을 채운다 (lo가 NULL이면 처음부터)
+static void iter_seek(const mmap_rbtree *m, mmap_iter *it, const key_t *lo) {
+  it->top = 0;
+  if (lo == NULL) {
+    push_left(m, it, m->tree.root);
+    return;
+  }
+
+  cnode_id cur = m->tree.root;
+  for (int depth = 0; cur != COMPACT_NIL && depth < RBTREE_MAX_HEIGHT; depth++) {
+    if (m->tree.nodes[cur].key < *lo) {
+      cur = child(m, cur, 1);
+    } else {
+      it->nodes[it->top++] = cur;
+      cur = child(m, cur, 0);
+    }
+  }
+}
+
+static cnode_id iter_next(const mmap_rbtree *m, mmap_iter *it) {
+  if (it->top == 0) return COMPACT_NIL;
+
+  cnode_id cur = it->nodes[--it->top];
+  push_left(m, it, child(m, cur, 1));
+  return cur;
+}
+
+const compact_node_t *mmap_rbtree_find(const mmap_rbtree *m, const key_t key) {
+  cnode_id cur = m->tree.root;
+  for (int depth = 0; cur != COMPACT_NIL && depth < RBTREE_MAX_HEIGHT; depth++) {
+    const compact_node_t *node = &m->tree.nodes[cur];
+    if (key == node->key) return node;
+    cur = child(m, cur, !(key < node->key));
+  }
+  return NULL;
+}
+
+const compact_node_t *mmap_rbtree_min(const mmap_rbtree *m) {
+  return edge(m, 0);
+}
+
+const compact_node_t *mmap_rbtree_max(const mmap_rbtree *m) {
+  return edge(m, 1);
+}
+
+// [lo, hi) 구간의 노드를 key 순서대로 callback에 넘긴다 (rbtree_range와 같은 규칙)
+size_t mmap_rbtree_range(const mmap_rbtree *m, const key_t lo, const key_t hi,
+                         mmap_range_fn callback, void *ctx) {
+  size_t count = 0;
+  mmap_iter it;
+  iter_seek(m, &it, &lo);
+  for (size_t steps = 1; steps < m->tree.used; steps++) {
+    cnode_id cur = iter_next(m, &it);
+    if (cur == COMPACT_NIL || !(m->tree.nodes[cur].key < hi)) break;
+    count++;
+    if (callback(&m->tree.nodes[cur], ctx) != 0) break;
+  }
+  return count;
+}
+
+int mmap_rbtree_to_array(const mmap_rbtree *m, key_t *arr, const size_t n) {
+  size_t idx = 0;
+  mmap_iter it;
+  iter_seek(m, &it, NULL);
+  while (idx < n && idx + 1 < m->tree.used) {
+    cnode_id cur = iter_next(m, &it);
+    if (cur == COMPACT_NIL) break;
+    arr[idx++] = m->tree.nodes[cur].key;
+  }
+  return (int)idx;
+}
@@ -0,0 +1,49 @@
+#ifndef _RBTREE_MMAP_H_
+#define _RBTREE_MMAP_H_
+
+#include "rbtree.h"
+#include "rbtree_compact.h"
+
+// 파일에 저장해 두었다가 mmap으로 바로 여는 읽기 전용 트리.
+// 노드는 compact 레이아웃(인덱스 링크, 0번이 nil)으로 저장하므로 어느 주소에
+// 매핑되어도 그대로 쓸 수 있고, 여는 데 드는 시간이 노드 수와 무관하다.
+// 노드는 루트부터 레벨 순서로 놓여 위쪽 몇 레벨이 같은 페이지에 모인다.
+// 파일은 저장한 머신과 같은 key_t 크기, 바이트 순서에서만 열린다.
+// key만 저장한다 (RBTREE_VALUE_TYPE의 value는 저장하지 않는다).
+// 조회 함수는 손상된 파일에서도 매핑 밖을 읽거나 멈추지 않지만 답은 틀릴 수 있다.
+// RBTREE_MULTISET이면 key를 count번씩 펼쳐 저장하므로 파일 형식은 같다.
+#define RBTREE_FILE_MAGIC "RBTREEv1"
+
+typedef struct {
+  char magic[8];
+  uint32_t byte_order;  // 0x01020304를 쓴 머신의 바이트 순서로 기록
+  uint32_t key_size;
+  uint32_t node_size;
+  cnode_id root;
+  uint64_t count;       // nil을 뺀 노드 수. 뒤에 count + 1개의 노드가 온다
+  uint64_t tag;         // 저장한 쪽이 정하는 값 (WAL은 체크포인트 세대를 기록한다)
+} rbtree_file_header;
+
+typedef struct {
+  compact_rbtree tree;  // nodes는 매핑된 파일 안을 가리킨다 (읽기 전용)
+  uint64_t tag;
+  void *base;
+  size_t length;
+} mmap_rbtree;
+
+// mmap_rbtree_range 콜백. 0이 아닌 값을 반환하면 순회를 멈춘다
+typedef int (*mmap_range_fn)(const compact_node_t *node, void *ctx);
+
+int rbtree_save(const rbtree *t, const char *path);
+int rbtree_save_tagged(const rbtree *t, const char *path, const uint64_t tag);
+mmap_rbtree *rbtree_open_mmap(const char *path);
+void rbtree_close_mmap(mmap_rbtree *m);
+
+const compact_node_t *mmap_rbtree_find(const mmap_rbtree *m, const key_t key);
+const compact_node_t *mmap_rbtree_min(const mmap_rbtree *m);
+const compact_node_t *mmap_rbtree_max(const mmap_rbtree *m);
+size_t mmap_rbtree_range(const mmap_rbtree *m, const key_t lo, const key_t hi,
+                         mmap_range_fn callback, void *ctx);
+int mmap_rbtree_to_array(const mmap_rbtree *m, key_t *arr, const size_t n);
+
+#endif  // _RBTREE_MMAP_H_
@@ -0,0 +1,294 @@
+#include "rbtree_persist.h"
+#include <stdlib.h>
+
+// 한 번의 수정에서 복사될 수 있는 만큼의 노드를 시작 전에 여분 목록에 채워 둔다.
+// 재귀 도중에 할당이 실패하면 되돌리기 어렵기 때문이다. 쓰고 남은 노드는
+// 다음 수정에서 다시 쓰므로 malloc 횟수는 실제로 복사한 노드 수와 같아진다.
+static int reserve_fill(prbtree *t) {
+  // left-leaning 트리의 높이는 2 * black height + 1 이하이고, 레벨마다
+  // 경로의 노드와 형제, 손자까지 복사될 수 있다
+  int bh = 0;
+  for (const pnode_t *cur = t->root; cur != NULL; cur = cur->left) {
+    if (cur->color == RBTREE_BLACK) bh++;
+  }
+  const int need = 4 * (2 * bh + 2) + 1;
+
+  while (t->spare_count < need) {
+    pnode_t *node = malloc(sizeof(*node));
+    if (node == NULL) return -1;
+    node->left = t->spare;
+    t->spare = node;
+    t->spare_count++;
+  }
+  return 0;
+}
+
+static pnode_t *reserve_take(prbtree *t) {
+  pnode_t *node = t->spare;
+  t->spare = node->left;
+  t->spare_count--;
+  return node;
+}
+
+// 새 참조는 이미 참조를 가진 쪽에서만 만들므로 순서를 맞출 필요가 없다
+static void retain(pnode_t *node) {
+  if (node != NULL) atomic_fetch_add_explicit(&node->refs, 1, memory_order_relaxed);
+}
+
+// 참조를 하나 놓고, 아무도 가리키지 않게 된 노드는 자식 참조와 함께 해제한다.
+// acq_rel이라 마지막으로 놓는 스레드는 다른 스레드가 그 노드에 한 일을 모두 본 뒤 해제한다
+static void release(pnode_t *node) {
+  while (node != NULL &&
+         atomic_fetch_sub_explicit(&node->refs, 1, memory_order_acq_rel) == 1) {
+    release(node->left);
+    pnode_t *right = node->right;
+    free(node);
+    node = right;
+  }
+}
+
+// 고칠 노드를 이 버전만의 것으로 만든다. 공유 중이면 복사본을 돌려준다.
+// refs가 1이면 이 버전만 가리키므로 다른 스레드가 새로 참조를 만들 수 없다. 복사한 뒤
+// 원래 노드의 참조는 release로 놓는다 (그 사이 다른 버전이 지워졌으면 여기서 해제된다)
+static pnode_t *own(prbtree *r, pnode_t *node) {
+  if (node == NULL || atomic_load_explicit(&node->refs, memory_order_acquire) == 1) return node;
+
+  pnode_t *copy = reserve_take(r);
+  copy->color = node->color;
+  copy->key = node->key;
+  copy->left = node->left;
+  copy->right = node->right;
+  atomic_init(&copy->refs, 1);
+  retain(copy->left);
+  retain(copy->right);
+  release(node);
+  return copy;
+}
+
+static int is_red(const pnode_t *node) {
+  return node != NULL && node->color == RBTREE_RED;
+}
+
+prbtree *new_prbtree(void) {
+  return calloc(1, sizeof(prbtree));
+}
+
+void delete_prbtree(prbtree *t) {
+  if (t == NULL) return;
+
+  release(t->root);
+  while (t->spare != NULL) {
+    free(reserve_take(t));
+  }
+  free(t);
+}
+
+// 루트를 공유하는 새 버전을 O(1)에 만든다
+prbtree *prbtree_snapshot(const prbtree *t) {
+  prbtree *s = calloc(1, sizeof(*s));
+  if (s == NULL) return NULL;
+
+  s->root = t->root;
+  retain(s->root);
+  return s;
+}
+
+// parent 포인터 없이 서브트리 루트를 받아 새 루트를 돌려주는 회전.
+// h와 h->right(왼쪽 회전) 또는 h->left(오른쪽 회전)는 이미 이 버전 소유여야 한다.
+pnode_t *persist_left_rotate(pnode_t *h) {
+  pnode_t *x = h->right;
+  h->right = x->left;
+  x->left = h;
+  x->color = h->color;
+  h->color = RBTREE_RED;
+  return x;
+}
+
+pnode_t *persist_right_rotate(pnode_t *h) {
+  pnode_t *x = h->left;
+  h->left = x->right;
+  x->right = h;
+  x->color = h->color;
+  h->color = RBTREE_RED;
+  return x;
+}
+
+static pnode_t *rotate_left(prbtree *r, pnode_t *h) {
+  h->right = own(r, h->right);
+  return persist_left_rotate(h);
+}
+
+static pnode_t *rotate_right(prbtree *r, pnode_t *h) {
+  h->left = own(r, h->left);
+  return persist_right_rotate(h);
+}
+
+// 2-3 트리의 4-노드를 쪼개거나(삽입) 합치는(삭제) 색 뒤집기
+static void color_flip_owned(prbtree *r, pnode_t *h) {
+  h->left = own(r, h->left);
+  h->right = own(r, h->right);
+  h->color = !h->color;
+  if (h->left) h->left->color = !h->left->color;
+  if (h->right) h->right->color = !h->right->color;
+}
+
+// 올라오면서 left-leaning 규칙을 복구
+static pnode_t *balance(prbtree *r, pnode_t *h) {
+  if (is_red(h->right) && !is_red(h->left)) h = rotate_left(r, h);
+  if (is_red(h->left) && is_red(h->left->left)) h = rotate_right(r, h);
+  if (is_red(h->left) && is_red(h->right)) color_flip_owned(r, h);
+  return h;
+}
+
+static pnode_t *insert_node(prbtree *r, pnode_t *h, const key_t key) {
+  if (h == NULL) {
+    pnode_t *node = reserve_take(r);
+    node->color = RBTREE_RED;
+    node->key = key;
+    atomic_init(&node->refs, 1);
+    node->left = node->right = NULL;
+    return node;
+  }
+
+  // 같은 key는 오른쪽으로 보낸다 (rbtree_insert와 같은 multiset 규칙)
+  if (key < h->key) {
+    h->left = insert_node(r, own(r, h->left), key);
+  } else {
+    h->right = insert_node(r, own(r, h->right), key);
+  }
+  return balance(r, h);
+}
+
+int prbtree_insert(prbtree *t, const key_t key) {
+  if (reserve_fill(t) != 0) return -1;
+
+  t->root = insert_node(t, own(t, t->root), key);
+  t->root->color = RBTREE_BLACK;
+  return 0;
+}
+
+// h->left 쪽으로 내려가기 전에 h->left나 그 왼쪽 자식이 RED가 되도록 만든다
+static pnode_t *move_red_left(prbtree *r, pnode_t *h) {
+  color_flip_owned(r, h);
+  if (is_red(h->right->left)) {
+    h->right = rotate_right(r, h->right);
+    h = rotate_left(r, h);
+    color_flip_owned(r, h);
+  }
+  return h;
+}
+
+static pnode_t *move_red_right(prbtree *r, pnode_t *h) {
+  color_flip_owned(r, h);
+  if (is_red(h->left->left)) {
+    h = rotate_right(r, h);
+    color_flip_owned(r, h);
+  }
+  return h;
+}
+
+// 최소 노드를 떼어 *min에 넘긴다 (노드는 해제하지 않는다)
+static pnode_t *erase_min(prbtree *r, pnode_t *h, pnode_t **min) {
+  if (h->left == NULL) {
+    *min = h;
+    return NULL;
+  }
+
+  if (!is_red(h->left) && !is_red(h->left->left)) h = move_red_left(r, h);
+  h->left = erase_min(r, own(r, h->left), min);
+  return balance(r, h);
+}
+
+// key가 트리에 있다는 것이 보장된 상태에서 그중 하나를 지운다
+static pnode_t *erase_node(prbtree *r, pnode_t *h, const key_t key) {
+  if (key < h->key) {
+    if (!is_red(h->left) && !is_red(h->left->left)) h = move_red_left(r, h);
+    h->left = erase_node(r, own(r, h->left), key);
+  } else {
+    if (is_red(h->left)) h = rotate_right(r, h);
+    if (key == h->key && h->right == NULL) {
+      release(h);
+      return NULL;
+    }
+    // move_red_right가 회전했다면 h는 원래 h의 왼쪽 자식이고, 같은 key가 여러 개일
+    // 때 그 key가 같을 수 있다. 이때는 원래 h가 있는 오른쪽으로 내려가서 지운다
+    pnode_t *top = h;
+    if (!is_red(h->right) && !is_red(h->right->left)) h = move_red_right(r, h);
+    if (h == top && key == h->key) {
+      // 오른쪽 서브트리의 최소 노드를 떼어 와서 h 자리에 올린다
+      pnode_t *min;
+      h->right = erase_min(r, own(r, h->right), &min);
+      min->color = h->color;
+      min->left = h->left;
+      min->right = h->right;
+      h->left = h->right = NULL;
+      release(h);
+      h = min;
+    } else {
+      h->right = erase_node(r, own(r, h->right), key);
+    }
+  }
+  return balance(r, h);
+}
+
+int prbtree_erase(prbtree *t, const key_t key) {
+  if (prbtree_find(t, key) == NULL) return -1;
+
+  if (reserve_fill(t) != 0) return -1;
+
+  pnode_t *root = own(t, t->root);
+  if (!is_red(root->left) && !is_red(root->right)) root->color = RBTREE_RED;
+  t->root = erase_node(t, root, key);
+  if (t->root != NULL) t->root->color = RBTREE_BLACK;
+  return 0;
+}
+
+const pnode_t *prbtree_find(const prbtree *t, const key_t key) {
+  const pnode_t *cur = t->root;
+  while (cur != NULL) {
+    if (key == cur->key) {
+      return cur;
+    } else if (key < cur->key) {
+      cur = cur->left;
+    } else {
+      cur = cur->right;
+    }
+  }
+  return NULL;
+}
+
+const pnode_t *prbtree_min(const prbtree *t) {
+  const pnode_t *cur = t->root;
+  while (cur != NULL && cur->left != NULL) {
+    cur = cur->left;
+  }
+  return cur;
+}
+
+const pnode_t *prbtree_max(const prbtree *t) {
+  const pnode_t *cur = t->root;
+  while (cur != NULL && cur->right != NULL) {
+    cur = cur->right;
+  }
+  return cur;
+}
+
+int prbtree_to_array(const prbtree *t, key_t *arr, const size_t n) {
+  if (t == NULL) return -1;
+
+  // parent 포인터가 없으므로 높이만큼의 스택으로 중위 순회
+  const pnode_t *stack[RBTREE_MAX_HEIGHT];
+  int top = 0;
+  int idx = 0;
+  const pnode_t *cur = t->root;
+  while ((cur != NULL || top > 0) && idx < n) {
+    while (cur != NULL) {
+      stack[top++] = cur;
+      cur = cur->left;
+    }
+    cur = stack[--top];
+    arr[idx++] = cur->key;
+    cur = cur->right;
+  }
+  return idx;
+}
@@ -0,0 +1,46 @@
+#ifndef _RBTREE_PERSIST_H_
+#define _RBTREE_PERSIST_H_
+
+#include "rbtree.h"
+#include <stdatomic.h>
+
+// 경로 복사 방식의 persistent 레드블랙 트리 (left-leaning 변형).
+// 노드에 parent 포인터가 없어 여러 버전이 서브트리를 공유할 수 있고,
+// refs는 그 노드를 가리키는 부모 노드와 버전(루트)의 수다.
+// 수정은 refs가 1인 노드만 제자리에서 고치고, 공유된 노드는 복사한 뒤 고친다.
+// 그래서 insert/erase는 루트에서 내려가는 경로의 O(log n)개 노드만 복사한다.
+//
+// 서로 다른 버전은 다른 스레드에서 동시에 읽고 고치고 지울 수 있다. 공유 노드의 refs는
+// 원자적으로 바꾸므로, 한 스레드가 스냅샷을 지우는 동안 다른 스레드가 같은 노드를 복사해도
+// 된다. 한 버전을 고치는 연산과 그 버전의 prbtree_snapshot은 호출한 쪽이 직렬화해야 한다
+// (snapshot은 t->root를 읽어 refs를 올린다).
+typedef struct pnode_t {
+  color_t color;
+  key_t key;
+  _Atomic int refs;
+  struct pnode_t *left, *right;
+} pnode_t;
+
+// 트리의 한 버전. 빈 트리는 root가 NULL
+typedef struct {
+  pnode_t *root;
+  pnode_t *spare;   // 복사에 쓸 여분 노드 (left로 연결)
+  int spare_count;
+} prbtree;
+
+prbtree *new_prbtree(void);
+void delete_prbtree(prbtree *t);
+prbtree *prbtree_snapshot(const prbtree *t);
+
+pnode_t *persist_left_rotate(pnode_t *h);
+pnode_t *persist_right_rotate(pnode_t *h);
+
+int prbtree_insert(prbtree *t, const key_t key);
+int prbtree_erase(prbtree *t, const key_t key);
+
+const pnode_t *prbtree_find(const prbtree *t, const key_t key);
+const pnode_t *prbtree_min(const prbtree *t);
+const pnode_t *prbtree_max(const prbtree *t);
+int prbtree_to_array(const prbtree *t, key_t *arr, const size_t n);
+
+#endif  // _RBTREE_PERSIST_H_
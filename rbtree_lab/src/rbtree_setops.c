@@ -0,0 +1,231 @@
+#include "rbtree.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// split/join 기반의 분할 정복 집합 연산.
+// b의 루트 key로 a를 나누고 양쪽을 재귀로 처리한 뒤 join으로 잇는다.
+// b가 작은 쪽일 때 O(m log(n/m + 1))이며, 위쪽 몇 단계는 두 재귀를 스레드로 나눠 돌린다.
+//
+// - union: 두 트리의 노드를 모은다. 양쪽에 있는 key는 나누는 쪽(b) 노드만 남기고 a의 노드는 버린다.
+//   MULTISET이면 남긴 노드의 count를 두 count 중 큰 값으로 한다
+// - intersect: t1의 노드 중 key가 t2에도 있는 것만 남긴다
+// - difference: t1의 노드 중 key가 t2에 없는 것만 남긴다
+
+// 이 black height 미만인 서브트리는 스레드를 만들 만큼 크지 않다
+#define SETOP_PAR_MIN_BH 10
+
+// 나눌 작업 수를 코어 수 대신 정하는 환경 변수. 코어가 하나인 머신에서도 스레드 경로를 시험할 수 있다
+#define SETOP_THREADS_ENV "RBTREE_SETOP_THREADS"
+
+typedef enum { SETOP_UNION, SETOP_INTERSECT, SETOP_DIFFERENCE } setop_t;
+
+typedef struct {
+  rbtree *t;         // nil과 풀을 참조하기 위한 트리
+  setop_t op;
+  int par_depth;     // 이 깊이까지만 재귀를 스레드로 나눈다
+  int depth;
+  node_t *a, *b;
+  int bha, bhb;
+  node_t *result;
+  int bh;
+  // 버릴 서브트리 루트들 (parent 포인터로 연결). 여러 스레드가 같은 풀을
+  // 동시에 건드리지 않도록 작업이 모두 끝난 뒤 한 번에 풀에 반환한다.
+  node_t *garbage, *garbage_tail;
+} setop_task;
+
+static void discard(setop_task *task, node_t *node) {
+  if (node == task->t->nil) return;
+
+  node->parent = task->garbage;
+  if (task->garbage == NULL) task->garbage_tail = node;
+  task->garbage = node;
+}
+
+static void adopt_garbage(setop_task *task, setop_task *child) {
+  if (child->garbage == NULL) return;
+
+  child->garbage_tail->parent = task->garbage;
+  if (task->garbage == NULL) task->garbage_tail = child->garbage_tail;
+  task->garbage = child->garbage;
+}
+
+// 두 서브트리를 가운데 노드 없이 잇는다. r의 최소 노드를 떼어 가운데로 쓴다
+static node_t *join2(rbtree *t, node_t *l, int bhl, node_t *r, int bhr, int *bh) {
+  if (r == t->nil) {
+    *bh = bhl;
+    return l;
+  }
+  if (l == t->nil) {
+    *bh = bhr;
+    return r;
+  }
+
+  node_t *m = r;
+  while (m->left != t->nil) {
+    m = m->left;
+  }
+  rbtree sub = { .root = r, .nil = t->nil, .pool = t->pool, .size = RBTREE_SIZE_UNKNOWN,
+                 .leftmost = t->nil, .rightmost = t->nil };
+  unlink_node(&sub, m);
+  return join_nodes(t, l, bhl, m, sub.root, black_height(t, sub.root), bh);
+}
+
+// 떼어 낸 서브트리는 루트가 RED일 수 있으므로 BLACK으로 바꾸고 black height를 맞춘다
+static node_t *detach(rbtree *t, node_t *node, int *bh) {
+  if (node == t->nil) return node;
+
+  node->parent = t->nil;
+  if (node->color == RBTREE_RED) {
+    node->color = RBTREE_BLACK;
+    (*bh)++;
+  }
+  return node;
+}
+
+static void setop_run(setop_task *task);
+
+static void *setop_thread(void *arg) {
+  setop_run(arg);
+  return NULL;
+}
+
+static void setop_run(setop_task *task) {
+  rbtree *t = task->t;
+  node_t *a = task->a, *b = task->b;
+
+  if (b == t->nil) {
+    if (task->op == SETOP_INTERSECT) {
+      discard(task, a);
+      task->result = t->nil;
+      task->bh = 0;
+    } else {
+      task->result = a;
+      task->bh = task->bha;
+    }
+    return;
+  }
+  if (a == t->nil) {
+    if (task->op == SETOP_UNION) {
+      task->result = b;
+      task->bh = task->bhb;
+    } else {
+      discard(task, b);
+      task->result = t->nil;
+      task->bh = 0;
+    }
+    return;
+  }
+
+  // b의 루트 k를 기준으로 b와 a를 양쪽으로 나눈다
+  node_t *k = b;
+  int child_bh = task->bhb - (k->color == RBTREE_BLACK ? 1 : 0);
+  int bh_bl = child_bh, bh_br = child_bh;
+  node_t *bl = detach(t, k->left, &bh_bl);
+  node_t *br = detach(t, k->right, &bh_br);
+  k->left = k->right = t->nil;
+
+  node_t *a_lo, *a_hi, *a_eq = t->nil;
+  int bh_lo, bh_hi, bh_eq = 0;
+  split_nodes(t, a, task->bha, k->key, 0, &a_lo, &bh_lo, &a_hi, &bh_hi);
+  {
+    // a에서 k와 같은 key를 따로 떼어 낸다
+    node_t *rest;
+    int bh_rest;
+    split_nodes(t, a_hi, bh_hi, k->key, 1, &a_eq, &bh_eq, &rest, &bh_rest);
+    a_hi = rest;
+    bh_hi = bh_rest;
+  }
+
+  setop_task left = { t, task->op, task->par_depth, task->depth + 1,
+                      a_lo, bl, bh_lo, bh_bl, NULL, 0, NULL, NULL };
+  setop_task right = { t, task->op, task->par_depth, task->depth + 1,
+                       a_hi, br, bh_hi, bh_br, NULL, 0, NULL, NULL };
+
+  pthread_t tid;
+  int forked = task->depth < task->par_depth && task->bhb >= SETOP_PAR_MIN_BH &&
+               pthread_create(&tid, NULL, setop_thread, &left) == 0;
+  if (!forked) setop_run(&left);
+  setop_run(&right);
+  if (forked) pthread_join(tid, NULL);
+
+  adopt_garbage(task, &left);
+  adopt_garbage(task, &right);
+
+  if (task->op == SETOP_UNION) {
+    // 양쪽에 있는 key는 b의 노드만 남긴다
+#ifdef RBTREE_MULTISET
+    // a_eq는 k와 key가 같은 노드 하나뿐이다
+    if (a_eq != t->nil && a_eq->count > k->count) k->count = a_eq->count;
+#endif
+    discard(task, a_eq);
+    task->result = join_nodes(t, left.result, left.bh, k, right.result, right.bh, &task->bh);
+    return;
+  }
+
+  discard(task, k);
+  int bh_mid;
+  node_t *mid = left.result;
+  bh_mid = left.bh;
+  if (task->op == SETOP_INTERSECT) {
+    mid = join2(t, mid, bh_mid, a_eq, bh_eq, &bh_mid);
+  } else {
+    discard(task, a_eq);
+  }
+  task->result = join2(t, mid, bh_mid, right.result, right.bh, &task->bh);
+}
+
+static rbtree *setop(rbtree *t1, rbtree *t2, setop_t op) {
+  share_pool(t1, t2);
+
+  int bh1 = black_height(t1, t1->root);
+  int bh2 = black_height(t2, t2->root);
+  setop_task task = { t1, op, 0, 0, t1->root, t2->root, bh1, bh2, NULL, 0, NULL, NULL };
+
+  // union은 대칭이므로 더 작은 트리의 루트로 나눈다
+  if (op == SETOP_UNION && bh1 < bh2) {
+    task.a = t2->root; task.bha = bh2;
+    task.b = t1->root; task.bhb = bh1;
+  }
+
+  // 코어 수만큼의 작업이 생기는 깊이까지만 스레드를 만든다.
+  // RBTREE_SETOP_THREADS가 있으면 코어 수 대신 쓴다 (1이면 나누지 않는다)
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *env = getenv(SETOP_THREADS_ENV);
+  if (env != NULL && atol(env) > 0) cpus = atol(env);
+  while (cpus > 1 && (1L << task.par_depth) < cpus) {
+    task.par_depth++;
+  }
+
+  setop_run(&task);
+
+  // 결과의 크기는 첫 rbtree_size가 센다
+  t1->root = task.result;
+  t1->size = RBTREE_SIZE_UNKNOWN;
+#ifdef RBTREE_ORDER_STAT
+  t1->size = t1->root->size;
+#endif
+  reset_bounds(t1);
+  t2->root = t2->nil;
+  delete_rbtree(t2);
+
+  node_t *garbage = task.garbage;
+  while (garbage != NULL) {
+    node_t *next = garbage->parent;
+    delete_node(t1, garbage);
+    garbage = next;
+  }
+  return t1;
+}
+
+rbtree *rbtree_union(rbtree *t1, rbtree *t2) {
+  return setop(t1, t2, SETOP_UNION);
+}
+
+rbtree *rbtree_intersect(rbtree *t1, rbtree *t2) {
+  return setop(t1, t2, SETOP_INTERSECT);
+}
+
+rbtree *rbtree_difference(rbtree *t1, rbtree *t2) {
+  return setop(t1, t2, SETOP_DIFFERENCE);
+}
@@ -0,0 +1,350 @@
+#include "rbtree_sharded.h"
+#include <stdlib.h>
+#include <string.h>
+
+// shard 하나에 처음 주는 slot 수. 경계는 slot 단위로 옮기므로 클수록 잘게 나눌 수 있다
+#define SHARD_SLOTS 64
+// size가 ref의 1.5배를 넘으면 뜨거운 것으로 본다. 두 배로 잡으면 빈 shard 옆에서 절반씩 나눠
+// 가진 두 shard가 평균의 딱 두 배에 머물러 더 퍼지지 않는다
+#define SHARD_HOT(size, ref) (2 * (size) > 3 * (ref))
+// 이보다 작은 shard는 나누지 않는다. 크기를 비교하는 간격의 최솟값이기도 하다
+#define SHARD_CHECK_MIN 1024
+
+// 다른 shard의 락 없이 읽고 쓰는 size는 쪼개 읽지 않도록 원자적으로 다룬다
+#define LOAD(p) __atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELAXED)
+
+static size_t next_check(size_t size) {
+  return size + (size / 4 > SHARD_CHECK_MIN ? size / 4 : SHARD_CHECK_MIN);
+}
+
+static void lock_span(sharded_rbtree *st, int from, int to) {
+  for (int k = from; k < to; k++) {
+    pthread_mutex_lock(&st->shards[k].lock);
+  }
+}
+
+static void unlock_span(sharded_rbtree *st, int from, int to) {
+  for (int k = from; k < to; k++) {
+    pthread_mutex_unlock(&st->shards[k].lock);
+  }
+}
+
+sharded_rbtree *new_sharded_rbtree(int nshards, const key_t lo, const key_t hi) {
+  if (nshards < 1 || hi < lo) return NULL;
+
+  sharded_rbtree *st = calloc(1, sizeof(*st));
+  if (st == NULL) return NULL;
+
+  // shard마다 SHARD_SLOTS개쯤 돌아가도록 slot 폭을 고른다
+  if ((key_t)0.5 != 0) {
+    st->lo = (double)lo;
+    st->nslots = (hi > lo) ? (size_t)nshards * SHARD_SLOTS : 1;
+    st->scale = (hi > lo) ? st->nslots / ((double)hi - st->lo) : 0;
+  } else {
+    st->base = rbtree_key_bits(lo);
+    const uint64_t span = rbtree_key_bits(hi) - st->base;
+    while ((span >> st->shift) >= (uint64_t)nshards * SHARD_SLOTS) {
+      st->shift++;
+    }
+    st->nslots = (size_t)(span >> st->shift) + 1;
+  }
+  if ((size_t)nshards > st->nslots) nshards = (int)st->nslots;
+
+  st->owner = malloc(st->nslots * sizeof(int));
+  st->first = malloc((nshards + 1) * sizeof(size_t));
+  st->shards = aligned_alloc(64, nshards * sizeof(rbtree_shard));
+  if (st->owner == NULL || st->first == NULL || st->shards == NULL) {
+    free(st->owner);
+    free(st->first);
+    free(st->shards);
+    free(st);
+    return NULL;
+  }
+
+  memset(st->shards, 0, nshards * sizeof(rbtree_shard));
+  st->nshards = nshards;
+  for (int k = 0; k <= nshards; k++) {
+    st->first[k] = k * st->nslots / nshards;
+  }
+  for (int k = 0; k < nshards; k++) {
+    rbtree_shard *s = &st->shards[k];
+    pthread_mutex_init(&s->lock, NULL);
+    s->check_at = SHARD_CHECK_MIN;
+    s->tree = new_rbtree();
+    for (size_t slot = st->first[k]; slot < st->first[k + 1]; slot++) {
+      st->owner[slot] = k;
+    }
+  }
+  for (int k = 0; k < nshards; k++) {
+    if (st->shards[k].tree == NULL) {
+      delete_sharded_rbtree(st);
+      return NULL;
+    }
+  }
+  return st;
+}
+
+void delete_sharded_rbtree(sharded_rbtree *st) {
+  if (st == NULL) return;
+
+  for (int k = 0; k < st->nshards; k++) {
+    pthread_mutex_destroy(&st->shards[k].lock);
+    delete_rbtree(st->shards[k].tree);
+  }
+  free(st->shards);
+  free(st->first);
+  free(st->owner);
+  free(st);
+}
+
+// 범위 밖의 key는 양 끝 slot에 넣는다
+size_t sharded_rbtree_slot(const sharded_rbtree *st, const key_t key) {
+  if ((key_t)0.5 != 0) {
+    const double x = ((double)key - st->lo) * st->scale;
+    if (!(x > 0)) return 0;
+    return x < st->nslots ? (size_t)x : st->nslots - 1;
+  }
+
+  const uint64_t bits = rbtree_key_bits(key);
+  if (bits <= st->base) return 0;
+
+  const uint64_t slot = (bits - st->base) >> st->shift;
+  return slot < st->nslots ? (size_t)slot : st->nslots - 1;
+}
+
+// key의 slot을 맡은 shard를 잠그고 그 번호를 반환한다.
+// 잠그기 전에 경계가 옮겨졌으면 새 주인을 다시 찾는다
+static int lock_key(sharded_rbtree *st, const key_t key) {
+  const size_t slot = sharded_rbtree_slot(st, key);
+  while (1) {
+    const int k = __atomic_load_n(&st->owner[slot], __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&st->shards[k].lock);
+    if (LOAD(st->owner[slot]) == k) return k;
+    pthread_mutex_unlock(&st->shards[k].lock);
+  }
+}
+
+// 정렬된 keys에서 slot이 slot 이상인 첫 위치
+static size_t slot_lower_bound(const sharded_rbtree *st, const key_t *keys, size_t n, size_t slot) {
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (sharded_rbtree_slot(st, keys[mid]) < slot) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// shard a와 a + 1의 key를 모아 가운데에 가까운 slot 경계에서 다시 나누고, 두 트리를 새
+// 노드 풀로 새로 짓는다. 그 사이 이미 고르게 나뉘었거나 메모리가 모자라면 그대로 둔다
+static void rebalance(sharded_rbtree *st, int a) {
+  rbtree_shard *l = &st->shards[a], *r = &st->shards[a + 1];
+  pthread_mutex_lock(&l->lock);
+  pthread_mutex_lock(&r->lock);
+
+  const size_t n = l->size + r->size;
+  const size_t big = l->size > r->size ? l->size : r->size;
+  key_t *keys = NULL;
+  if (n == 0 || !SHARD_HOT(big, n - big)) goto out;
+
+  // 양쪽 모두 slot을 하나 이상 남긴다
+  const size_t lo_slot = st->first[a] + 1, hi_slot = st->first[a + 2] - 1;
+  if (lo_slot > hi_slot) goto out;
+
+  keys = malloc(n * sizeof(key_t));
+  if (keys == NULL) goto out;
+  rbtree_to_array(l->tree, keys, l->size);
+  rbtree_to_array(r->tree, keys + l->size, r->size);
+
+  // 가운데 key의 slot 앞과 뒤 중 가운데에 더 가까운 쪽을 경계로 삼는다
+  const size_t half = n / 2;
+  const size_t mid_slot = sharded_rbtree_slot(st, keys[half]);
+  const size_t before = slot_lower_bound(st, keys, n, mid_slot);
+  const size_t after = slot_lower_bound(st, keys, n, mid_slot + 1);
+  size_t boundary = (half - before <= after - half) ? mid_slot : mid_slot + 1;
+  if (boundary < lo_slot) boundary = lo_slot;
+  if (boundary > hi_slot) boundary = hi_slot;
+  if (boundary == st->first[a + 1]) goto out;
+  const size_t cut = slot_lower_bound(st, keys, n, boundary);
+
+  rbtree *lt = rbtree_from_sorted_array(keys, cut);
+  rbtree *rt = rbtree_from_sorted_array(keys + cut, n - cut);
+  if (lt == NULL || rt == NULL) {
+    delete_rbtree(lt);
+    delete_rbtree(rt);
+    goto out;
+  }
+
+  for (size_t slot = boundary; slot < st->first[a + 1]; slot++) {
+    __atomic_store_n(&st->owner[slot], a + 1, __ATOMIC_RELEASE);
+  }
+  for (size_t slot = st->first[a + 1]; slot < boundary; slot++) {
+    __atomic_store_n(&st->owner[slot], a, __ATOMIC_RELEASE);
+  }
+  st->first[a + 1] = boundary;
+
+  delete_rbtree(l->tree);
+  delete_rbtree(r->tree);
+  l->tree = lt;
+  r->tree = rt;
+  STORE(l->size, cut);
+  STORE(r->size, n - cut);
+  l->check_at = next_check(cut);
+  r->check_at = next_check(n - cut);
+
+out:
+  free(keys);
+  pthread_mutex_unlock(&r->lock);
+  pthread_mutex_unlock(&l->lock);
+}
+
+// shard k가 평균보다 뜨거워졌으면 더 작은 이웃과 나눈다
+static void maybe_rebalance(sharded_rbtree *st, int k) {
+  if (st->nshards < 2) return;
+
+  size_t total = 0;
+  for (int i = 0; i < st->nshards; i++) {
+    total += LOAD(st->shards[i].size);
+  }
+  const size_t size = LOAD(st->shards[k].size);
+  if (size < SHARD_CHECK_MIN || !SHARD_HOT(size, total / st->nshards)) return;
+
+  int j = k + 1;
+  if (k == st->nshards - 1 ||
+      (k > 0 && LOAD(st->shards[k - 1].size) < LOAD(st->shards[k + 1].size))) {
+    j = k - 1;
+  }
+  rebalance(st, k < j ? k : j);
+}
+
+int sharded_rbtree_insert(sharded_rbtree *st, const key_t key) {
+  const int k = lock_key(st, key);
+  rbtree_shard *s = &st->shards[k];
+  node_t *node = rbtree_insert(s->tree, key);
+  int check = 0;
+  if (node != NULL) {
+    STORE(s->size, s->size + 1);
+    if (s->size >= s->check_at) {
+      s->check_at = next_check(s->size);
+      check = 1;
+    }
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  if (check) maybe_rebalance(st, k);
+  return node == NULL ? -1 : 0;
+}
+
+int sharded_rbtree_erase(sharded_rbtree *st, const key_t key) {
+  const int k = lock_key(st, key);
+  rbtree_shard *s = &st->shards[k];
+  node_t *p = rbtree_find(s->tree, key);
+  int ret = -1;
+  if (p != s->tree->nil) {
+    ret = rbtree_erase(s->tree, p);
+    STORE(s->size, s->size - 1);
+  }
+  pthread_mutex_unlock(&s->lock);
+  return ret;
+}
+
+int sharded_rbtree_contains(sharded_rbtree *st, const key_t key) {
+  const int k = lock_key(st, key);
+  const rbtree *t = st->shards[k].tree;
+  const int found = rbtree_find(t, key) != t->nil;
+  pthread_mutex_unlock(&st->shards[k].lock);
+  return found;
+}
+
+size_t sharded_rbtree_size(const sharded_rbtree *st) {
+  size_t total = 0;
+  for (int k = 0; k < st->nshards; k++) {
+    total += LOAD(st->shards[k].size);
+  }
+  return total;
+}
+
+// 앞의 빈 shard를 잡아 둔 채로 넘어가야 그 사이 경계가 옮겨져도 key를 놓치지 않는다
+int sharded_rbtree_min(sharded_rbtree *st, key_t *key) {
+  int found = -1, k = 0;
+  while (k < st->nshards) {
+    rbtree_shard *s = &st->shards[k++];
+    pthread_mutex_lock(&s->lock);
+    if (s->size > 0) {
+      *key = rbtree_min(s->tree)->key;
+      found = 0;
+      break;
+    }
+  }
+  unlock_span(st, 0, k);
+  return found;
+}
+
+// 락은 언제나 번호 순으로 잡으므로, 뒤쪽 shard가 모두 비어 있으면 한 칸 앞부터 다시 잡는다
+int sharded_rbtree_max(sharded_rbtree *st, key_t *key) {
+  for (int from = st->nshards - 1; from >= 0; from--) {
+    lock_span(st, from, st->nshards);
+    for (int k = st->nshards - 1; k >= from; k--) {
+      if (st->shards[k].size > 0) {
+        *key = rbtree_max(st->shards[k].tree)->key;
+        unlock_span(st, from, st->nshards);
+        return 0;
+      }
+    }
+    unlock_span(st, from, st->nshards);
+  }
+  return -1;
+}
+
+typedef struct {
+  rbtree_range_fn callback;
+  void *ctx;
+  int stopped;
+} range_relay;
+
+static int relay(node_t *node, void *arg) {
+  range_relay *r = arg;
+  r->stopped = r->callback(node, r->ctx);
+  return r->stopped;
+}
+
+size_t sharded_rbtree_range(sharded_rbtree *st, const key_t lo, const key_t hi,
+                            rbtree_range_fn callback, void *ctx) {
+  if (!(lo < hi)) return 0;
+
+  // 양 끝 slot의 주인을 잠근 뒤에도 그대로면 그 사이 slot은 모두 잠근 shard의 것이다.
+  // 경계를 옮기는 도중에 읽으면 순서가 뒤집혀 보일 수 있으므로 그때도 다시 읽는다
+  const size_t slot_lo = sharded_rbtree_slot(st, lo), slot_hi = sharded_rbtree_slot(st, hi);
+  int a, b;
+  while (1) {
+    a = __atomic_load_n(&st->owner[slot_lo], __ATOMIC_ACQUIRE);
+    b = __atomic_load_n(&st->owner[slot_hi], __ATOMIC_ACQUIRE);
+    if (a > b) continue;
+
+    lock_span(st, a, b + 1);
+    if (LOAD(st->owner[slot_lo]) == a && LOAD(st->owner[slot_hi]) == b) break;
+    unlock_span(st, a, b + 1);
+  }
+
+  range_relay r = { callback, ctx, 0 };
+  size_t count = 0;
+  for (int k = a; k <= b && !r.stopped; k++) {
+    count += rbtree_range(st->shards[k].tree, lo, hi, relay, &r);
+  }
+  unlock_span(st, a, b + 1);
+  return count;
+}
+
+int sharded_rbtree_to_array(sharded_rbtree *st, key_t *arr, const size_t n) {
+  lock_span(st, 0, st->nshards);
+  size_t idx = 0;
+  for (int k = 0; k < st->nshards && idx < n; k++) {
+    idx += rbtree_to_array(st->shards[k].tree, arr + idx, n - idx);
+  }
+  unlock_span(st, 0, st->nshards);
+  return (int)idx;
+}
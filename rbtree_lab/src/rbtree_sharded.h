@@ -0,0 +1,62 @@
+#ifndef _RBTREE_SHARDED_H_
+#define _RBTREE_SHARDED_H_
+
+#include "rbtree.h"
+#include <pthread.h>
+
+// key 범위를 나눠 맡는 rbtree 여러 개를 하나의 집합처럼 쓰는 핸들.
+// shard마다 자기 락과 자기 노드 풀을 가지므로 서로 다른 shard에 대한 쓰기는 동시에 진행된다.
+//
+// [lo, hi] 범위를 slot으로 나누고, slot마다 맡은 shard 번호를 표에 적어 두어 key 하나의
+// shard를 O(1)에 찾는다. 정수 key는 rbtree_key_bits를 2의 거듭제곱 폭으로, 실수 key는 값을
+// 같은 폭으로 나눈다 (실수의 비트 패턴은 지수 단위로 벌어진다). 범위 밖의 key는 양 끝 slot으로
+// 간다. shard 번호와 slot 순서가 같으므로 shard를 번호 순으로 이으면 key 순서가 된다.
+//
+// 한 shard가 평균의 1.5배보다 커지면 작은 이웃과 경계 slot을 옮겨 두 shard를 새로
+// 짓는다. 경계는 두 shard의 락을 모두 잡은 채로만 옮기고, key 하나를 다루는 연산은 shard 락을
+// 잡은 뒤 slot의 주인이 그대로인지 다시 확인한다.
+// 여러 shard에 걸친 연산(min/max, range, to_array)은 관련 shard의 락을 번호 순으로 모두 잡고
+// 읽으므로 한 시점의 모습을 본다.
+typedef struct {
+  pthread_mutex_t lock;
+  rbtree *tree;
+  size_t size;      // key 수. 락 없이 다른 shard도 읽는다
+  size_t check_at;  // size가 여기에 닿으면 다른 shard와 크기를 비교한다
+} __attribute__((aligned(64))) rbtree_shard;
+
+typedef struct {
+  int nshards;
+  rbtree_shard *shards;
+  uint64_t base;    // 첫 slot이 시작하는 rbtree_key_bits(lo)
+  int shift;        // slot 하나의 폭은 1 << shift
+  double lo, scale; // 실수 key의 slot은 (key - lo) * scale
+  size_t nslots;
+  int *owner;       // slot을 맡은 shard 번호
+  size_t *first;    // shard마다 첫 slot. first[nshards] == nslots
+} sharded_rbtree;
+
+// nshards개로 나누되 [lo, hi]의 slot 수보다 많이 만들지는 않는다
+sharded_rbtree *new_sharded_rbtree(int nshards, const key_t lo, const key_t hi);
+void delete_sharded_rbtree(sharded_rbtree *st);
+
+// key가 속한 slot 번호
+size_t sharded_rbtree_slot(const sharded_rbtree *st, const key_t key);
+
+int sharded_rbtree_insert(sharded_rbtree *st, const key_t key);
+int sharded_rbtree_erase(sharded_rbtree *st, const key_t key);
+int sharded_rbtree_contains(sharded_rbtree *st, const key_t key);
+
+// 동시에 쓰는 스레드가 있으면 근삿값
+size_t sharded_rbtree_size(const sharded_rbtree *st);
+
+// 가장 작은/큰 key를 *key에 채운다. 비어 있으면 -1
+int sharded_rbtree_min(sharded_rbtree *st, key_t *key);
+int sharded_rbtree_max(sharded_rbtree *st, key_t *key);
+
+// [lo, hi)의 노드를 key 순서대로 callback에 넘긴다 (노드는 callback 안에서만 유효).
+// callback이 0이 아닌 값을 돌려주면 멈추며, 넘긴 노드 수를 반환한다
+size_t sharded_rbtree_range(sharded_rbtree *st, const key_t lo, const key_t hi,
+                            rbtree_range_fn callback, void *ctx);
+int sharded_rbtree_to_array(sharded_rbtree *st, key_t *arr, const size_t n);
+
+#endif  // _RBTREE_SHARDED_H_
@@ -0,0 +1,126 @@
+#include "rbtree.h"
+#include <stdlib.h>
+#include <string.h>
+
+// 이보다 짧은 배열은 histogram을 만드는 비용이 더 커서 qsort로 정렬한다
+#define RADIX_MIN 256
+
+static int key_compare(const void *a, const void *b) {
+  const key_t x = *(const key_t *)a;
+  const key_t y = *(const key_t *)b;
+  return (x > y) - (x < y);
+}
+
+// 부호 있는 정수는 부호 비트를 뒤집고, 실수는 음수면 모든 비트를, 양수면 부호 비트를 뒤집는다
+uint64_t rbtree_key_bits(key_t key) {
+  uint64_t bits;
+  if (sizeof(key_t) == 8) {
+    uint64_t u;
+    memcpy(&u, &key, 8);
+    bits = u;
+  } else if (sizeof(key_t) == 4) {
+    uint32_t u;
+    memcpy(&u, &key, 4);
+    bits = u;
+  } else if (sizeof(key_t) == 2) {
+    uint16_t u;
+    memcpy(&u, &key, 2);
+    bits = u;
+  } else {
+    uint8_t u;
+    memcpy(&u, &key, 1);
+    bits = u;
+  }
+
+  const uint64_t sign = (uint64_t)1 << (sizeof(key_t) * 8 - 1);
+  const uint64_t mask = sign | (sign - 1);
+  if ((key_t)0.5 != 0) {
+    return (bits & sign) ? ~bits & mask : bits | sign;
+  }
+  if ((key_t)-1 < 0) {
+    return bits ^ sign;
+  }
+  return bits;
+}
+
+// 8비트씩 낮은 자리부터 나누는 LSD radix sort. 모든 자리의 histogram을 한 번에 세고,
+// 모든 key의 값이 같은 자리(작은 정수 key의 위쪽 바이트 등)는 건너뛴다.
+// 임시 버퍼를 잡지 못하면 qsort로 정렬한다.
+void rbtree_sort_keys(key_t *arr, const size_t n) {
+  if (n < 2) return;
+
+  key_t *tmp = (n < RADIX_MIN) ? NULL : malloc(n * sizeof(key_t));
+  if (tmp == NULL) {
+    qsort(arr, n, sizeof(key_t), key_compare);
+    return;
+  }
+
+  size_t counts[sizeof(key_t)][256] = { { 0 } };
+  for (size_t i = 0; i < n; i++) {
+    uint64_t bits = rbtree_key_bits(arr[i]);
+    for (size_t d = 0; d < sizeof(key_t); d++) {
+      counts[d][(bits >> (8 * d)) & 0xff]++;
+    }
+  }
+
+  key_t *src = arr, *dst = tmp;
+  for (size_t d = 0; d < sizeof(key_t); d++) {
+    size_t *count = counts[d];
+    if (count[(rbtree_key_bits(src[0]) >> (8 * d)) & 0xff] == n) continue;
+
+    size_t offset = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      dst[count[(rbtree_key_bits(src[i]) >> (8 * d)) & 0xff]++] = src[i];
+    }
+
+    key_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != arr) memcpy(arr, src, n * sizeof(key_t));
+  free(tmp);
+}
+
+// 이웃한 key는 같은 경로를 지나므로 하나씩 반영할 때도 정렬된 순서면 위쪽 노드를 캐시에서 다시 읽는다
+static size_t insert_each(rbtree *t, const key_t *keys, size_t n) {
+  size_t i = 0;
+  while (i < n && rbtree_insert(t, keys[i]) != NULL) {
+    i++;
+  }
+  return i;
+}
+
+static size_t erase_each(rbtree *t, const key_t *keys, size_t n) {
+  size_t erased = 0;
+  for (size_t i = 0; i < n; i++) {
+    node_t *p = rbtree_find(t, keys[i]);
+    if (p != t->nil) {
+      rbtree_erase(t, p);
+      erased++;
+    }
+  }
+  return erased;
+}
+
+size_t rbtree_batch_apply(rbtree *t, const key_t *keys, const size_t n, int erase,
+                          rbtree_batch_rebuild rebuild) {
+  if (t == NULL || n == 0) return 0;
+
+  key_t *sorted = malloc(n * sizeof(key_t));
+  if (sorted == NULL) return erase ? erase_each(t, keys, n) : insert_each(t, keys, n);
+  memcpy(sorted, keys, n * sizeof(key_t));
+  rbtree_sort_keys(sorted, n);
+
+  size_t done;
+  if (rebuild == NULL || rebuild(t, sorted, n, &done) != 0) {
+    done = erase ? erase_each(t, sorted, n) : insert_each(t, sorted, n);
+  }
+  free(sorted);
+  return done;
+}
@@ -0,0 +1,315 @@
+#include "rbtree_wal.h"
+#include "rbtree_mmap.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WAL_MAGIC "RBWALv1"
+
+enum { WAL_INSERT = 1, WAL_ERASE = 2 };
+
+typedef struct {
+  char magic[8];
+  uint32_t key_size;
+  uint32_t reserved;
+  uint64_t epoch;
+} wal_header;
+
+typedef struct {
+  uint32_t op;
+  uint32_t check;  // op와 key의 FNV-1a. 끝이 잘리거나 덜 쓰인 레코드를 걸러낸다
+  key_t key;
+} wal_record;
+
+typedef struct {
+  key_t key;
+  size_t seq;
+  uint32_t op;
+} replay_op;
+
+static uint32_t record_check(const wal_record *r) {
+  uint32_t h = 2166136261u;
+  const unsigned char *p = (const unsigned char *)&r->op;
+  for (size_t i = 0; i < sizeof(r->op); i++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  p = (const unsigned char *)&r->key;
+  for (size_t i = 0; i < sizeof(r->key); i++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) return -1;
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static char *path_with(const char *base, const char *suffix) {
+  size_t len = strlen(base);
+  size_t slen = strlen(suffix);
+  char *path = malloc(len + slen + 1);
+  if (path == NULL) return NULL;
+  memcpy(path, base, len);
+  memcpy(path + len, suffix, slen + 1);
+  return path;
+}
+
+// 로그를 비우고 새 세대의 헤더만 남긴다
+static int reset_log(wal_rbtree *w, uint64_t epoch) {
+  wal_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, WAL_MAGIC, sizeof(h.magic));
+  h.key_size = sizeof(key_t);
+  h.epoch = epoch;
+
+  if (ftruncate(w->fd, 0) != 0) return -1;
+  if (write_all(w->fd, &h, sizeof(h)) != 0) return -1;
+  if (fsync(w->fd) != 0) return -1;
+  w->epoch = epoch;
+  return 0;
+}
+
+static int replay_compare(const void *a, const void *b) {
+  const replay_op *x = a;
+  const replay_op *y = b;
+  if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+  return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+// 스냅샷의 정렬된 key들에 로그 연산을 key별로 적용해 최종 key 배열을 만든다.
+// 연산을 (key, 순서)로 정렬하면 key마다 개수만 따라가면 되므로 트리를 거치지 않고
+// O(n + m log m)에 끝나고, 결과는 rbtree_from_sorted_array로 한 번에 올린다.
+static rbtree *replay(const key_t *snap, size_t ns, replay_op *ops, size_t nops) {
+  if (nops > 0) qsort(ops, nops, sizeof(replay_op), replay_compare);
+
+  size_t cap = ns + nops;
+  key_t *out = malloc((cap > 0 ? cap : 1) * sizeof(key_t));
+  if (out == NULL) return NULL;
+
+  size_t n = 0, i = 0, j = 0;
+  while (i < ns || j < nops) {
+    key_t key = (j == nops || (i < ns && snap[i] <= ops[j].key)) ? snap[i] : ops[j].key;
+    size_t count = 0;
+    for (; i < ns && snap[i] == key; i++) {
+      count++;
+    }
+    for (; j < nops && ops[j].key == key; j++) {
+      if (ops[j].op == WAL_INSERT) {
+        count++;
+      } else if (count > 0) {
+        count--;
+      }
+    }
+    while (count-- > 0) {
+      out[n++] = key;
+    }
+  }
+
+  rbtree *t = rbtree_from_sorted_array(out, n);
+  free(out);
+  return t;
+}
+
+// 로그에서 온전한 레코드만 읽어 ops로 옮긴다. 반환값은 유효한 로그의 끝 위치
+static size_t read_log(const unsigned char *data, size_t len, replay_op **ops, size_t *nops) {
+  size_t off = sizeof(wal_header);
+  size_t max = (len - off) / sizeof(wal_record);
+  *ops = malloc((max > 0 ? max : 1) * sizeof(replay_op));
+  *nops = 0;
+  if (*ops == NULL) return 0;
+
+  while (off + sizeof(wal_record) <= len) {
+    wal_record r;
+    memcpy(&r, data + off, sizeof(r));
+    if ((r.op != WAL_INSERT && r.op != WAL_ERASE) || r.check != record_check(&r)) break;
+
+    replay_op *op = &(*ops)[(*nops)++];
+    op->key = r.key;
+    op->seq = *nops;
+    op->op = r.op;
+    off += sizeof(r);
+  }
+  return off;
+}
+
+// 스냅샷을 읽고 같은 세대의 로그를 그 위에 재생한다.
+// 스냅샷이 로그보다 새 세대면 체크포인트가 로그를 비우기 전에 멈춘 것이므로 로그를 버린다.
+static int recover(wal_rbtree *w) {
+  key_t *snap = NULL;
+  size_t ns = 0;
+  uint64_t epoch = 0;
+
+  mmap_rbtree *m = rbtree_open_mmap(w->snap_path);
+  if (m != NULL) {
+    ns = m->tree.used - 1;
+    snap = malloc((ns > 0 ? ns : 1) * sizeof(key_t));
+    if (snap == NULL) {
+      rbtree_close_mmap(m);
+      return -1;
+    }
+    // 링크가 손상되어 노드를 다 돌지 못했거나 순서가 어긋난 스냅샷은 읽을 수 없는 것으로 본다
+    int broken = (size_t)mmap_rbtree_to_array(m, snap, ns) != ns;
+    for (size_t i = 1; !broken && i < ns; i++) {
+      broken = snap[i] < snap[i - 1];
+    }
+    epoch = m->tag;
+    rbtree_close_mmap(m);
+    if (broken) {
+      free(snap);
+      return -1;
+    }
+  } else if (access(w->snap_path, F_OK) == 0) {
+    return -1;  // 있는데 읽을 수 없는 스냅샷은 건너뛰지 않는다
+  }
+
+  struct stat st;
+  if (fstat(w->fd, &st) != 0) {
+    free(snap);
+    return -1;
+  }
+
+  replay_op *ops = NULL;
+  size_t nops = 0;
+  int fresh = 1;
+  if ((size_t)st.st_size >= sizeof(wal_header)) {
+    unsigned char *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, w->fd, 0);
+    if (data == MAP_FAILED) {
+      free(snap);
+      return -1;
+    }
+
+    const wal_header *h = (const wal_header *)data;
+    if (memcmp(h->magic, WAL_MAGIC, sizeof(h->magic)) != 0 || h->key_size != sizeof(key_t) ||
+        h->epoch > epoch) {
+      munmap(data, st.st_size);
+      free(snap);
+      return -1;
+    }
+
+    if (h->epoch == epoch) {
+      fresh = 0;
+      size_t end = read_log(data, st.st_size, &ops, &nops);
+      if (ops == NULL || (end < (size_t)st.st_size && ftruncate(w->fd, end) != 0)) {
+        munmap(data, st.st_size);
+        free(ops);
+        free(snap);
+        return -1;
+      }
+    }
+    munmap(data, st.st_size);
+  }
+
+  // 새 로그이거나, 헤더도 다 쓰지 못했거나, 이전 세대의 로그
+  if (fresh && reset_log(w, epoch) != 0) {
+    free(snap);
+    return -1;
+  }
+  w->epoch = epoch;
+
+  w->tree = replay(snap, ns, ops, nops);
+  free(ops);
+  free(snap);
+  return w->tree == NULL ? -1 : 0;
+}
+
+wal_rbtree *wal_rbtree_open(const char *base, const size_t group_size) {
+  wal_rbtree *w = calloc(1, sizeof(*w));
+  if (w == NULL) return NULL;
+
+  w->fd = -1;
+  w->group_size = group_size > 0 ? group_size : 1;
+  w->snap_path = path_with(base, ".snap");
+  w->log_path = path_with(base, ".log");
+  w->buf = malloc(w->group_size * sizeof(wal_record));
+  if (w->snap_path == NULL || w->log_path == NULL || w->buf == NULL) goto fail;
+
+  w->fd = open(w->log_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (w->fd < 0) goto fail;
+  if (recover(w) != 0) goto fail;
+  return w;
+
+fail:
+  if (w->fd >= 0) close(w->fd);
+  delete_rbtree(w->tree);
+  free(w->buf);
+  free(w->log_path);
+  free(w->snap_path);
+  free(w);
+  return NULL;
+}
+
+int wal_rbtree_close(wal_rbtree *w) {
+  if (w == NULL) return 0;
+
+  int ret = wal_rbtree_sync(w);
+  if (close(w->fd) != 0) ret = -1;
+  delete_rbtree(w->tree);
+  free(w->buf);
+  free(w->log_path);
+  free(w->snap_path);
+  free(w);
+  return ret;
+}
+
+// 쌓인 레코드를 한 번에 쓰고 fsync한다. 이 호출이 성공하면 그 전의 수정은 모두 살아남는다
+int wal_rbtree_sync(wal_rbtree *w) {
+  if (w->pending == 0) return 0;
+
+  // 일부만 쓰고 실패했다면 잘라 내서, 다시 시도할 때 레코드가 겹치지 않게 한다
+  off_t end = lseek(w->fd, 0, SEEK_END);
+  if (end < 0) return -1;
+  if (write_all(w->fd, w->buf, w->pending * sizeof(wal_record)) != 0) {
+    ftruncate(w->fd, end);
+    return -1;
+  }
+  if (fdatasync(w->fd) != 0) return -1;
+  w->pending = 0;
+  return 0;
+}
+
+static int append(wal_rbtree *w, uint32_t op, const key_t key) {
+  // 앞선 sync가 실패해 버퍼가 찬 채로 남아 있으면 먼저 비운다
+  if (w->pending == w->group_size && wal_rbtree_sync(w) != 0) return -1;
+
+  wal_record r;
+  memset(&r, 0, sizeof(r));
+  r.op = op;
+  r.key = key;
+  r.check = record_check(&r);
+  memcpy(w->buf + w->pending * sizeof(wal_record), &r, sizeof(r));
+  w->pending++;
+
+  return w->pending == w->group_size ? wal_rbtree_sync(w) : 0;
+}
+
+// 로그 쓰기에 실패하면 NULL을 반환한다 (메모리의 트리에는 이미 반영되어 있다)
+node_t *wal_rbtree_insert(wal_rbtree *w, const key_t key) {
+  node_t *node = rbtree_insert(w->tree, key);
+  if (node == NULL) return NULL;
+  return append(w, WAL_INSERT, key) == 0 ? node : NULL;
+}
+
+int wal_rbtree_erase(wal_rbtree *w, node_t *p) {
+  const key_t key = p->key;
+  if (rbtree_erase(w->tree, p) != 0) return -1;
+  return append(w, WAL_ERASE, key);
+}
+
+// 지금 트리를 다음 세대의 스냅샷으로 저장하고 로그를 비운다.
+// 스냅샷을 저장한 뒤 로그를 비우지 못하면 -1을 반환하는데, 그대로 두면 이후 레코드는
+// 복구 때 이전 세대 로그로 버려지므로 다시 체크포인트해야 한다.
+int wal_rbtree_checkpoint(wal_rbtree *w) {
+  if (wal_rbtree_sync(w) != 0) return -1;
+  if (rbtree_save_tagged(w->tree, w->snap_path, w->epoch + 1) != 0) return -1;
+  return reset_log(w, w->epoch + 1);
+}
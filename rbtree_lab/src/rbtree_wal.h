@@ -0,0 +1,35 @@
+#ifndef _RBTREE_WAL_H_
+#define _RBTREE_WAL_H_
+
+#include "rbtree.h"
+
+// rbtree 앞에 두는 write-ahead log.
+// 수정은 먼저 메모리 버퍼에 레코드로 쌓이고, group_size개가 모이거나
+// wal_rbtree_sync를 부르면 한 번의 write + fsync로 로그 파일에 내려간다 (group commit).
+// 따라서 마지막 sync 이후의 수정은 crash 때 잃을 수 있다.
+//
+// <base>.snap  체크포인트 시점의 트리 (rbtree_save 형식, tag에 세대 번호)
+// <base>.log   그 세대 이후의 insert/erase 레코드
+//
+// wal_rbtree_open은 스냅샷과 로그를 읽어 트리를 되살린다. 로그 끝의 잘린 레코드는 버린다.
+// key만 기록한다 (RBTREE_VALUE_TYPE의 value는 복구되지 않는다).
+typedef struct {
+  rbtree *tree;       // 조회는 이 트리에 직접 해도 된다. 수정은 wal_rbtree_*로만
+  char *snap_path, *log_path;
+  int fd;             // 로그 파일
+  uint64_t epoch;     // 지금 로그가 이어 붙는 스냅샷의 세대
+  unsigned char *buf; // 아직 로그에 쓰지 않은 레코드
+  size_t pending;     // buf에 쌓인 레코드 수
+  size_t group_size;
+} wal_rbtree;
+
+wal_rbtree *wal_rbtree_open(const char *base, const size_t group_size);
+int wal_rbtree_close(wal_rbtree *w);
+
+node_t *wal_rbtree_insert(wal_rbtree *w, const key_t key);
+int wal_rbtree_erase(wal_rbtree *w, node_t *p);
+
+int wal_rbtree_sync(wal_rbtree *w);
+int wal_rbtree_checkpoint(wal_rbtree *w);
+
+#endif  // _RBTREE_WAL_H_
@@ -0,0 +1,475 @@
+#include "rbtree.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 모든 트리가 공유하는 sentinel. 어떤 연산도 nil에 쓰지 않는다.
+static node_t nil_node = {
+  .color = RBTREE_BLACK,
+  .left  = &nil_node,
+  .right = &nil_node,
+};
+
+// 내려가는 동안 쓰는 지역 포인터(가짜 루트 위쪽)는 NULL일 수 있다
+static inline int is_red(const node_t *node) {
+  return node != NULL && node->color == RBTREE_RED;
+}
+
+// (key, 주소) 순서로 a가 b보다 앞인지. 같은 key는 주소로 순서를 정한다
+static inline int before(const key_t key, const node_t *a, const node_t *b) {
+  return key < b->key || (key == b->key && (uintptr_t)a < (uintptr_t)b);
+}
+
+// root를 dir 방향으로 돌린다. 올라온 노드를 BLACK, 내려간 root를 RED로 칠해 반환
+static node_t *rotate_single(node_t *root, int dir) {
+  node_t *save = root->link[!dir];
+  root->link[!dir] = save->link[dir];
+  save->link[dir] = root;
+  root->color = RBTREE_RED;
+  save->color = RBTREE_BLACK;
+  return save;
+}
+
+static node_t *rotate_double(node_t *root, int dir) {
+  root->link[!dir] = rotate_single(root->link[!dir], !dir);
+  return rotate_single(root, dir);
+}
+
+static node_t *alloc_node(rbtree *t) {
+  node_t *node;
+  if (t->free_list != NULL) {
+    node = t->free_list;
+    t->free_list = node->right;
+  } else {
+    if (t->chunks == NULL || t->chunks->used == TD_CHUNK) {
+      node_chunk_t *chunk = malloc(sizeof(*chunk));
+      if (chunk == NULL) return NULL;
+      chunk->next = t->chunks;
+      chunk->used = 0;
+      t->chunks = chunk;
+    }
+    node = &t->chunks->nodes[t->chunks->used++];
+  }
+
+#ifdef RBTREE_VALUE_TYPE
+  // rbtree_insert_value가 아닌 경로로 만든 노드의 value는 0이다
+  memset(&node->value, 0, sizeof(node->value));
+#endif
+  return node;
+}
+
+static void free_node(rbtree *t, node_t *node) {
+  node->right = t->free_list;
+  t->free_list = node;
+}
+
+rbtree *new_rbtree(void) {
+  rbtree *t = calloc(1, sizeof(*t));
+  if (t == NULL) return NULL;
+
+  t->nil = &nil_node;
+  t->root = t->nil;
+  return t;
+}
+
+// 노드는 모두 chunk 안에 있으므로 chunk만 놓으면 된다
+void delete_rbtree(rbtree *t) {
+  if (t == NULL) return;
+
+  while (t->chunks != NULL) {
+    node_chunk_t *next = t->chunks->next;
+    free(t->chunks);
+    t->chunks = next;
+  }
+  free(t);
+}
+
+// 내려가면서 자식 둘이 RED인 노드를 색 반전하고, 그 때문에 RED가 이어지면 바로 회전한다.
+// 새 노드를 붙이는 곳의 부모는 늘 BLACK이거나 그 자리에서 회전으로 고쳐지므로
+// 올라가며 고칠 일이 없다 (J. Walker의 top-down insert).
+node_t *rbtree_insert(rbtree *t, const key_t key) {
+  if (t == NULL) return NULL;
+
+  node_t *node = alloc_node(t);
+  if (node == NULL) return NULL;
+  node->color = RBTREE_RED;
+  node->key = key;
+  node->left = node->right = t->nil;
+
+  if (t->root == t->nil) {
+    t->root = node;
+  } else {
+    node_t head = { .color = RBTREE_BLACK, .left = t->nil, .right = t->root };
+    node_t *gg = &head;  // g의 부모
+    node_t *g = NULL, *p = NULL;
+    node_t *q = t->root;
+    int dir = 0, last = 0;
+
+    for (;;) {
+      if (q == t->nil) {
+        p->link[dir] = q = node;
+      } else if (is_red(q->left) && is_red(q->right)) {
+        q->color = RBTREE_RED;
+        q->left->color = RBTREE_BLACK;
+        q->right->color = RBTREE_BLACK;
+      }
+
+      if (is_red(q) && is_red(p)) {
+        int dir2 = gg->right == g;
+        if (q == p->link[last]) {
+          gg->link[dir2] = rotate_single(g, !last);
+        } else {
+          gg->link[dir2] = rotate_double(g, !last);
+        }
+      }
+
+      if (q == node) break;
+
+      last = dir;
+      dir = before(q->key, q, node);
+      if (g != NULL) gg = g;
+      g = p;
+      p = q;
+      q = q->link[dir];
+    }
+    t->root = head.right;
+  }
+
+  t->root->color = RBTREE_BLACK;
+  t->size++;
+  return node;
+}
+
+#ifdef RBTREE_VALUE_TYPE
+node_t *rbtree_insert_value(rbtree *t, const key_t key, const value_t value) {
+  node_t *node = rbtree_insert(t, key);
+  if (node != NULL) {
+    node->value = value;
+  }
+  return node;
+}
+#endif
+
+// 내려가는 동안 지금 노드 q를 늘 RED로(또는 RED 자식을 갖게) 만들어 두고, 맨 아래에서
+// 떼어 낸다. p를 지나 중위 순서상 바로 앞 노드(q)까지 내려간 뒤 q를 p 자리에 옮겨
+// 놓으므로 다른 노드의 주소와 내용은 그대로다. 회전으로 p가 내려가면 p의 부모(fp)도 따라 바꾼다.
+int rbtree_erase(rbtree *t, node_t *p_target) {
+  if (!t || !p_target || p_target == t->nil || t->root == t->nil) return -1;
+
+  node_t head = { .color = RBTREE_BLACK, .left = t->nil, .right = t->root };
+  node_t *q = &head, *p = NULL, *g = NULL;
+  node_t *f = NULL, *fp = NULL;  // 지울 노드와 그 부모
+  int dir = 1;
+
+  while (q->link[dir] != t->nil) {
+    int last = dir;
+    g = p;
+    p = q;
+    q = q->link[dir];
+    dir = before(q->key, q, p_target);
+    if (q == p_target) {
+      f = q;
+      fp = p;
+    }
+
+    if (is_red(q) || is_red(q->link[dir])) continue;
+
+    if (is_red(q->link[!dir])) {
+      p = p->link[last] = rotate_single(q, dir);
+      if (q == f) fp = p;
+    } else {
+      node_t *s = p->link[!last];
+      if (s == t->nil) continue;
+
+      if (!is_red(s->left) && !is_red(s->right)) {
+        p->color = RBTREE_BLACK;
+        s->color = RBTREE_RED;
+        q->color = RBTREE_RED;
+      } else {
+        int dir2 = g->right == p;
+        if (is_red(s->link[last])) {
+          g->link[dir2] = rotate_double(p, last);
+        } else {
+          g->link[dir2] = rotate_single(p, last);
+        }
+        if (p == f) fp = g->link[dir2];
+
+        q->color = g->link[dir2]->color = RBTREE_RED;
+        g->link[dir2]->left->color = RBTREE_BLACK;
+        g->link[dir2]->right->color = RBTREE_BLACK;
+      }
+    }
+  }
+
+  if (f != NULL) {
+    // q는 자식이 하나 이하다. q를 떼어 내고, f가 아니면 f의 자리에 앉힌다
+    p->link[p->right == q] = q->link[q->left == t->nil];
+    if (q != f) {
+      q->left = f->left;
+      q->right = f->right;
+      q->color = f->color;
+      fp->link[fp->right == f] = q;
+    }
+    free_node(t, f);
+    t->size--;
+  }
+
+  t->root = head.right;
+  if (t->root != t->nil) t->root->color = RBTREE_BLACK;
+  return f != NULL ? 0 : -1;
+}
+
+node_t *rbtree_find(const rbtree *t, const key_t key) {
+  node_t *cur = t->root;
+  while (cur != t->nil) {
+    if (key == cur->key) {
+      return cur;
+    } else if (key < cur->key) {
+      cur = cur->left;
+    } else {
+      cur = cur->right;
+    }
+  }
+  return t->nil;
+}
+
+// keys[i]를 찾은 결과를 out[i]에 채운다 (없으면 nil). 찾은 key의 수를 반환한다.
+size_t rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out) {
+  size_t found = 0;
+  for (size_t i = 0; i < n; i++) {
+    out[i] = rbtree_find(t, keys[i]);
+    found += (out[i] != t->nil);
+  }
+  return found;
+}
+
+// key 이상인 첫 노드. 없으면 nil
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key) {
+  node_t *found = t->nil;
+  node_t *cur = t->root;
+  while (cur != t->nil) {
+    if (cur->key < key) {
+      cur = cur->right;
+    } else {
+      found = cur;
+      cur = cur->left;
+    }
+  }
+  return found;
+}
+
+// key보다 큰 첫 노드. 없으면 nil
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key) {
+  node_t *found = t->nil;
+  node_t *cur = t->root;
+  while (cur != t->nil) {
+    if (key < cur->key) {
+      found = cur;
+      cur = cur->left;
+    } else {
+      cur = cur->right;
+    }
+  }
+  return found;
+}
+
+// [lo, hi) 구간의 노드를 key 순서대로 callback에 넘긴다.
+// lower_bound 경로에서 왼쪽으로 꺾은 노드를 스택에 쌓아 두고 중위 순회를 이어 간다.
+size_t rbtree_range(const rbtree *t, const key_t lo, const key_t hi,
+                    rbtree_range_fn callback, void *ctx) {
+  node_t *stack[RBTREE_MAX_HEIGHT];
+  int top = 0;
+  node_t *cur = t->root;
+  while (cur != t->nil) {
+    if (cur->key < lo) {
+      cur = cur->right;
+    } else {
+      stack[top++] = cur;
+      cur = cur->left;
+    }
+  }
+
+  size_t count = 0;
+  while (top > 0) {
+    node_t *node = stack[--top];
+    if (!(node->key < hi)) break;
+    count++;
+    if (callback(node, ctx) != 0) break;
+    for (cur = node->right; cur != t->nil; cur = cur->left) {
+      stack[top++] = cur;
+    }
+  }
+  return count;
+}
+
+node_t *rbtree_min(const rbtree *t) {
+  node_t *cur = t->root;
+  while (cur->left != t->nil) {
+    cur = cur->left;
+  }
+  return cur;
+}
+
+node_t *rbtree_max(const rbtree *t) {
+  node_t *cur = t->root;
+  while (cur->right != t->nil) {
+    cur = cur->right;
+  }
+  return cur;
+}
+
+size_t rbtree_size(const rbtree *t) {
+  return t->size;
+}
+
+// 중위 순회 기준 다음 노드. parent가 없으므로 루트부터 (key, 주소)로 찾는다
+node_t *rbtree_next(const rbtree *t, const node_t *node) {
+  if (node == t->nil) return t->nil;
+
+  node_t *found = t->nil;
+  node_t *cur = t->root;
+  while (cur != t->nil) {
+    if (before(node->key, node, cur)) {
+      found = cur;
+      cur = cur->left;
+    } else {
+      cur = cur->right;
+    }
+  }
+  return found;
+}
+
+// 중위 순회 기준 이전 노드. 첫 노드였으면 nil을 반환
+node_t *rbtree_prev(const rbtree *t, const node_t *node) {
+  if (node == t->nil) return t->nil;
+
+  node_t *found = t->nil;
+  node_t *cur = t->root;
+  while (cur != t->nil) {
+    if (before(cur->key, cur, node)) {
+      found = cur;
+      cur = cur->right;
+    } else {
+      cur = cur->left;
+    }
+  }
+  return found;
+}
+
+rbtree_cursor rbtree_cursor_first(const rbtree *t) {
+  rbtree_cursor c = { t, rbtree_min(t) };
+  return c;
+}
+
+rbtree_cursor rbtree_cursor_last(const rbtree *t) {
+  rbtree_cursor c = { t, rbtree_max(t) };
+  return c;
+}
+
+int rbtree_cursor_valid(const rbtree_cursor *c) {
+  return c->node != c->tree->nil;
+}
+
+node_t *rbtree_cursor_next(rbtree_cursor *c) {
+  c->node = rbtree_next(c->tree, c->node);
+  return c->node;
+}
+
+node_t *rbtree_cursor_prev(rbtree_cursor *c) {
+  c->node = rbtree_prev(c->tree, c->node);
+  return c->node;
+}
+
+int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
+  if (t == NULL) return -1;
+
+  node_t *stack[RBTREE_MAX_HEIGHT];
+  int top = 0;
+  size_t idx = 0;
+  node_t *cur = t->root;
+  while (idx < n && (cur != t->nil || top > 0)) {
+    for (; cur != t->nil; cur = cur->left) {
+      stack[top++] = cur;
+    }
+    cur = stack[--top];
+    arr[idx++] = cur->key;
+    cur = cur->right;
+  }
+  return (int)idx;
+}
+
+// 정렬된 arr[lo, hi)로 높이가 최소인 서브트리를 만든다 (rbtree.c의 build_sorted와 같은 색칠).
+// 같은 key는 주소 순서여야 하므로 노드를 key 순서대로 먼저 꺼내 nodes에 둔다.
+static node_t *build_sorted(rbtree *t, node_t **nodes, const key_t *arr, size_t lo, size_t hi,
+                            int depth, int red_depth) {
+  if (lo >= hi) return t->nil;
+
+  size_t mid = lo + (hi - lo) / 2;
+  node_t *node = nodes[mid];
+  node->key   = arr[mid];
+  node->color = (depth == red_depth && depth > 0) ? RBTREE_RED : RBTREE_BLACK;
+  node->left  = build_sorted(t, nodes, arr, lo, mid, depth + 1, red_depth);
+  node->right = build_sorted(t, nodes, arr, mid + 1, hi, depth + 1, red_depth);
+  return node;
+}
+
+static int node_address_compare(const void *a, const void *b) {
+  const uintptr_t x = (uintptr_t)*(node_t *const *)a;
+  const uintptr_t y = (uintptr_t)*(node_t *const *)b;
+  return (x > y) - (x < y);
+}
+
+// 정렬된 배열로부터 O(n log n)에 트리를 만든다 (노드 주소 정렬이 들어간다)
+rbtree *rbtree_from_sorted_array(const key_t *arr, const size_t n) {
+  rbtree *t = new_rbtree();
+  if (t == NULL || n == 0) return t;
+
+  node_t **nodes = malloc(n * sizeof(node_t *));
+  if (nodes == NULL) {
+    delete_rbtree(t);
+    return NULL;
+  }
+  for (size_t i = 0; i < n; i++) {
+    nodes[i] = alloc_node(t);
+    if (nodes[i] == NULL) {
+      free(nodes);
+      delete_rbtree(t);
+      return NULL;
+    }
+  }
+  // chunk는 새것이 앞에 오므로 꺼낸 순서와 주소 순서가 다를 수 있다
+  qsort(nodes, n, sizeof(node_t *), node_address_compare);
+
+  int red_depth = 0;
+  for (size_t m = n; m > 1; m >>= 1) {
+    red_depth++;
+  }
+  t->root = build_sorted(t, nodes, arr, 0, n, 0, red_depth);
+  t->size = n;
+  free(nodes);
+  return t;
+}
+
+// 정렬되지 않은 배열은 복사본을 정렬한 뒤 rbtree_from_sorted_array로 만든다
+rbtree *rbtree_from_array(const key_t *arr, const size_t n) {
+  if (n == 0) return new_rbtree();
+
+  key_t *sorted = malloc(n * sizeof(key_t));
+  if (sorted == NULL) return NULL;
+  memcpy(sorted, arr, n * sizeof(key_t));
+  rbtree_sort_keys(sorted, n);
+
+  rbtree *t = rbtree_from_sorted_array(sorted, n);
+  free(sorted);
+  return t;
+}
+
+// 다시 짓는 경로가 없으므로 정렬된 순서로 하나씩 반영한다
+size_t rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n) {
+  return rbtree_batch_apply(t, keys, n, 0, NULL);
+}
+
+size_t rbtree_erase_batch(rbtree *t, const key_t *keys, const size_t n) {
+  return rbtree_batch_apply(t, keys, n, 1, NULL);
+}
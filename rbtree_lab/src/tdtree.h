@@ -0,0 +1,104 @@
+#ifndef _TDTREE_H_
+#define _TDTREE_H_
+
+// rbtree.h의 API를 top-down 레드블랙 트리로 구현할 때의 타입과 함수 (-DRBTREE_TOPDOWN).
+// key_t, value_t, color_t는 rbtree.h에서 먼저 정의한 뒤 이 헤더를 포함한다.
+#ifndef _RBTREE_H_
+#error "include rbtree.h instead"
+#endif
+
+#if defined(RBTREE_ORDER_STAT) || defined(RBTREE_INTERVAL) || defined(RBTREE_MULTISET) || defined(RBTREE_STATS)
+#error "RBTREE_ORDER_STAT, RBTREE_INTERVAL, RBTREE_MULTISET and RBTREE_STATS are not supported by the top-down engine"
+#endif
+
+#ifdef RBTREE_FAT
+#error "RBTREE_FAT and RBTREE_TOPDOWN cannot be combined"
+#endif
+
+// insert와 erase가 루트에서 내려가는 한 번의 패스 안에서 회전과 색 변경을 끝낸다.
+// 올라오며 고치는 단계가 없으므로 노드에 parent가 없고, 수정 한 번에 경로를 한 번만 읽는다.
+//
+// parent가 없으므로 같은 key의 노드는 주소 순서로 놓는다. 그래야 rbtree_erase가
+// 주어진 노드 하나를 key와 주소로 찾아 내려갈 수 있다.
+// rbtree_next/prev와 커서는 루트부터 다시 찾으므로 O(log n)이다 (rbtree_range와
+// rbtree_to_array는 스택으로 순회해 O(log n + k)).
+// 서브트리를 옮기는 연산(split/join, 집합 연산)과 파일 저장은 제공하지 않는다.
+typedef struct node_t {
+  color_t color;
+  key_t key;
+  union {
+    struct {
+      struct node_t *left, *right;
+    };
+    struct node_t *link[2];  // link[0]이 left, link[1]이 right
+  };
+#ifdef RBTREE_VALUE_TYPE
+  value_t value;
+#endif
+} node_t;
+
+#define TD_CHUNK 256
+
+// 노드를 TD_CHUNK개씩 잡아 두는 묶음
+typedef struct node_chunk_t {
+  struct node_chunk_t *next;
+  size_t used;
+  node_t nodes[TD_CHUNK];
+} node_chunk_t;
+
+typedef struct {
+  node_t *root;
+  node_t *nil;          // 모든 트리가 공유하는 sentinel
+  size_t size;          // key 수
+  node_t *free_list;    // 반환된 노드 (right로 연결)
+  node_chunk_t *chunks;
+} rbtree;
+
+// 중위 순회용 커서. node가 tree->nil이면 끝에 도달한 상태
+typedef struct {
+  const rbtree *tree;
+  node_t *node;
+} rbtree_cursor;
+
+// rbtree_range 콜백. 0이 아닌 값을 반환하면 순회를 멈춘다
+typedef int (*rbtree_range_fn)(node_t *node, void *ctx);
+
+rbtree *new_rbtree(void);
+void delete_rbtree(rbtree *t);
+
+node_t *rbtree_insert(rbtree *t, const key_t);
+#ifdef RBTREE_VALUE_TYPE
+node_t *rbtree_insert_value(rbtree *t, const key_t key, const value_t value);
+#endif
+
+node_t *rbtree_find(const rbtree *, const key_t);
+size_t rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out);
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key);
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key);
+size_t rbtree_range(const rbtree *t, const key_t lo, const key_t hi,
+                    rbtree_range_fn callback, void *ctx);
+node_t *rbtree_min(const rbtree *);
+node_t *rbtree_max(const rbtree *);
+size_t rbtree_size(const rbtree *t);
+
+int rbtree_erase(rbtree *t, node_t *p);
+
+// 정렬한 keys를 순서대로 하나씩 반영한다 (rbtree.h의 batch 연산과 같은 의미, rbtree_batch_apply)
+size_t rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n);
+size_t rbtree_erase_batch(rbtree *t, const key_t *keys, const size_t n);
+
+node_t *rbtree_next(const rbtree *t, const node_t *node);
+node_t *rbtree_prev(const rbtree *t, const node_t *node);
+
+rbtree_cursor rbtree_cursor_first(const rbtree *t);
+rbtree_cursor rbtree_cursor_last(const rbtree *t);
+int rbtree_cursor_valid(const rbtree_cursor *c);
+node_t *rbtree_cursor_next(rbtree_cursor *c);
+node_t *rbtree_cursor_prev(rbtree_cursor *c);
+
+int rbtree_to_array(const rbtree *t, key_t *arr, const size_t);
+
+rbtree *rbtree_from_sorted_array(const key_t *arr, const size_t n);
+rbtree *rbtree_from_array(const key_t *arr, const size_t n);
+
+#endif  // _TDTREE_H_
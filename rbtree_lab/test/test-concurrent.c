@@ -0,0 +1,384 @@
+#include <assert.h>
+#include <pthread.h>
+#include <rbtree_concurrent.h>
+#include <rbtree_persist.h>
+#include <rbtree_sharded.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Multi-threaded stress tests for concurrent_rbtree and sharded_rbtree.
+// Even keys are inserted up front and never erased, so every reader must
+// always find them, including on the hit path that skips the seqlock
+// check. Writers churn odd keys while a checker thread periodically takes
+// the write lock and verifies the red-black invariants.
+// The sharded writers favour a narrow band of keys so shard boundaries move
+// while readers and range scans are running.
+
+#define NUM_READERS 4
+#define NUM_WRITERS 2
+#define KEY_SPACE 4096
+#define WRITER_OPS 200000
+#define READER_OPS 400000
+
+#define SHARDS 8
+#define SHARD_KEY_SPACE 65536
+#define SHARD_HOT_BAND 8192
+
+#define SNAPSHOTS 400
+#define SNAPSHOT_EVERY 64
+
+static concurrent_rbtree *ct;
+static sharded_rbtree *st;
+static atomic_int writers_done;
+static prbtree *snapshots[SNAPSHOTS];
+static atomic_int published;
+
+static unsigned int next_rand(unsigned int *state)
+{
+  *state = *state * 1103515245u + 12345u;
+  return *state >> 8;
+}
+
+static int check_black_height(const node_t *p, const node_t *nil, const color_t parent_color)
+{
+  if (p == nil)
+  {
+    return 0;
+  }
+  assert(!(parent_color == RBTREE_RED && p->color == RBTREE_RED));
+  if (p->left != nil)
+  {
+    assert(p->left->parent == p && p->left->key <= p->key);
+  }
+  if (p->right != nil)
+  {
+    assert(p->right->parent == p && p->right->key >= p->key);
+  }
+  const int lh = check_black_height(p->left, nil, p->color);
+  assert(lh == check_black_height(p->right, nil, p->color));
+  return lh + (p->color == RBTREE_BLACK ? 1 : 0);
+}
+
+static void check_tree(void)
+{
+  pthread_mutex_lock(&ct->write_lock);
+  const rbtree *t = ct->tree;
+  assert(t->root == t->nil || t->root->color == RBTREE_BLACK);
+  check_black_height(t->root, t->nil, RBTREE_BLACK);
+  pthread_mutex_unlock(&ct->write_lock);
+}
+
+static void *reader(void *arg)
+{
+  unsigned int state = (unsigned int)(size_t)arg;
+  for (int i = 0; i < READER_OPS; i++)
+  {
+    const unsigned int key = next_rand(&state) % KEY_SPACE;
+    const int found = concurrent_rbtree_contains(ct, (key_t)key);
+    if (key % 2 == 0)
+    {
+      assert(found);
+    }
+  }
+  return NULL;
+}
+
+static void *writer(void *arg)
+{
+  unsigned int state = (unsigned int)(size_t)arg;
+  for (int i = 0; i < WRITER_OPS; i++)
+  {
+    const key_t key = (key_t)(next_rand(&state) % (KEY_SPACE / 2) * 2 + 1);
+    if (next_rand(&state) % 2)
+    {
+      assert(concurrent_rbtree_insert(ct, key) == 0);
+    }
+    else
+    {
+      concurrent_rbtree_erase(ct, key);
+    }
+  }
+  atomic_fetch_add(&writers_done, 1);
+  return NULL;
+}
+
+static void *checker(void *arg)
+{
+  while (atomic_load(&writers_done) < NUM_WRITERS)
+  {
+    check_tree();
+  }
+  return NULL;
+}
+
+static void *shard_reader(void *arg)
+{
+  unsigned int state = (unsigned int)(size_t)arg;
+  for (int i = 0; i < READER_OPS; i++)
+  {
+    const unsigned int key = next_rand(&state) % SHARD_KEY_SPACE;
+    const int found = sharded_rbtree_contains(st, (key_t)key);
+    if (key % 2 == 0)
+    {
+      assert(found);
+    }
+  }
+  return NULL;
+}
+
+static void *shard_writer(void *arg)
+{
+  unsigned int state = (unsigned int)(size_t)arg;
+  for (int i = 0; i < WRITER_OPS; i++)
+  {
+    // three inserts to one erase, mostly inside the hot band
+    const unsigned int space = (next_rand(&state) % 4) ? SHARD_HOT_BAND : SHARD_KEY_SPACE;
+    const key_t key = (key_t)(next_rand(&state) % (space / 2) * 2 + 1);
+    if (next_rand(&state) % 4)
+    {
+      assert(sharded_rbtree_insert(st, key) == 0);
+    }
+    else
+    {
+      sharded_rbtree_erase(st, key);
+    }
+  }
+  atomic_fetch_add(&writers_done, 1);
+  return NULL;
+}
+
+typedef struct
+{
+  key_t last;
+  key_t next_even;
+  size_t n;
+} scan_ctx;
+
+// keys come in order and no even key is skipped
+static int scan_key(node_t *node, void *arg)
+{
+  scan_ctx *c = arg;
+  assert(c->n == 0 || c->last <= node->key);
+  assert(node->key <= c->next_even);
+  if (node->key == c->next_even)
+  {
+    c->next_even += 2;
+  }
+  c->last = node->key;
+  c->n++;
+  return 0;
+}
+
+static void *scanner(void *arg)
+{
+  unsigned int state = (unsigned int)(size_t)arg;
+  while (atomic_load(&writers_done) < NUM_WRITERS)
+  {
+    const key_t lo = (key_t)(next_rand(&state) % (SHARD_KEY_SPACE / 2) * 2);
+    const key_t hi = lo + (key_t)(next_rand(&state) % 4096);
+    scan_ctx c = {0, lo, 0};
+    sharded_rbtree_range(st, lo, hi, scan_key, &c);
+    assert(c.next_even >= hi || c.next_even == SHARD_KEY_SPACE);
+
+    key_t min;
+    assert(sharded_rbtree_min(st, &min) == 0 && min == 0);
+  }
+  return NULL;
+}
+
+// Erased nodes must not go back to the pool while a reader that entered
+// before the erase is still inside; once it leaves they are reclaimed.
+static void test_reclaim(void)
+{
+  concurrent_rbtree *rt = new_concurrent_rbtree();
+  assert(rt != NULL);
+  for (key_t key = 0; key < KEY_SPACE; key++)
+  {
+    assert(concurrent_rbtree_insert(rt, key) == 0);
+  }
+
+  // pretend a reader stalled inside the current epoch
+  atomic_ulong *stalled = &rt->stripes[0].active[atomic_load(&rt->epoch) & 1];
+  atomic_fetch_add(stalled, 1);
+  for (key_t key = 0; key < KEY_SPACE; key++)
+  {
+    assert(concurrent_rbtree_erase(rt, key) == 0);
+    assert(concurrent_rbtree_insert(rt, key + KEY_SPACE) == 0);
+    assert(tree_pool(rt->tree)->free_list == NULL);
+  }
+  assert(atomic_load(&rt->epoch) <= 1);
+
+  atomic_fetch_sub(stalled, 1);
+  for (key_t key = KEY_SPACE; key < KEY_SPACE + EPOCH_BATCH; key++)
+  {
+    assert(concurrent_rbtree_erase(rt, key) == 0);
+  }
+  assert(tree_pool(rt->tree)->free_list != NULL);
+  assert(rbtree_size(rt->tree) == KEY_SPACE - EPOCH_BATCH);
+
+  delete_concurrent_rbtree(rt);
+}
+
+// Round i inserts the keys [i * SNAPSHOT_EVERY, (i + 1) * SNAPSHOT_EVERY) and
+// erases the odd keys of round i - 1, then publishes a snapshot.
+static void *snapshot_writer(void *arg)
+{
+  prbtree *live = (prbtree *)arg;
+  for (int i = 0; i < SNAPSHOTS; i++)
+  {
+    for (int k = i * SNAPSHOT_EVERY; k < (i + 1) * SNAPSHOT_EVERY; k++)
+    {
+      assert(prbtree_insert(live, (key_t)k) == 0);
+    }
+    for (int k = (i - 1) * SNAPSHOT_EVERY + 1; i > 0 && k < i * SNAPSHOT_EVERY; k += 2)
+    {
+      assert(prbtree_erase(live, (key_t)k) == 0);
+    }
+    snapshots[i] = prbtree_snapshot(live);
+    atomic_store_explicit(&published, i + 1, memory_order_release);
+  }
+  return NULL;
+}
+
+// Readers check and drop snapshots while the writer keeps copying the
+// nodes they share
+static void *snapshot_reader(void *arg)
+{
+  key_t *keys = calloc((SNAPSHOTS + 1) * SNAPSHOT_EVERY, sizeof(key_t));
+  for (int i = (int)(size_t)arg; i < SNAPSHOTS; i += NUM_READERS)
+  {
+    while (atomic_load_explicit(&published, memory_order_acquire) <= i)
+    {
+      sched_yield();
+    }
+    const int n = prbtree_to_array(snapshots[i], keys, (SNAPSHOTS + 1) * SNAPSHOT_EVERY);
+    assert(n == (i + 1) * SNAPSHOT_EVERY / 2 + SNAPSHOT_EVERY / 2);
+    for (int j = 0; j < n; j++)
+    {
+      const long long k = (long long)keys[j];
+      assert(j == 0 || (long long)keys[j - 1] < k);
+      assert(k % 2 == 0 || k >= (long long)i * SNAPSHOT_EVERY);
+    }
+    delete_prbtree(snapshots[i]);
+  }
+  free(keys);
+  return NULL;
+}
+
+static void test_snapshots(void)
+{
+  prbtree *live = new_prbtree();
+  assert(live != NULL);
+  atomic_store(&published, 0);
+
+  pthread_t readers[NUM_READERS], writer;
+  pthread_create(&writer, NULL, snapshot_writer, live);
+  for (size_t i = 0; i < NUM_READERS; i++)
+  {
+    pthread_create(&readers[i], NULL, snapshot_reader, (void *)i);
+  }
+  pthread_join(writer, NULL);
+  for (int i = 0; i < NUM_READERS; i++)
+  {
+    pthread_join(readers[i], NULL);
+  }
+  delete_prbtree(live);
+}
+
+static void test_sharded(void)
+{
+  st = new_sharded_rbtree(SHARDS, 0, SHARD_KEY_SPACE - 1);
+  assert(st != NULL);
+  for (key_t key = 0; key < SHARD_KEY_SPACE; key += 2)
+  {
+    assert(sharded_rbtree_insert(st, key) == 0);
+  }
+  size_t boundaries[SHARDS + 1];
+  memcpy(boundaries, st->first, sizeof(boundaries));
+
+  atomic_store(&writers_done, 0);
+  pthread_t readers[NUM_READERS], writers[NUM_WRITERS], scan;
+  for (size_t i = 0; i < NUM_WRITERS; i++)
+  {
+    pthread_create(&writers[i], NULL, shard_writer, (void *)(i + 1));
+  }
+  for (size_t i = 0; i < NUM_READERS; i++)
+  {
+    pthread_create(&readers[i], NULL, shard_reader, (void *)(i + 101));
+  }
+  pthread_create(&scan, NULL, scanner, (void *)201);
+
+  for (int i = 0; i < NUM_READERS; i++)
+  {
+    pthread_join(readers[i], NULL);
+  }
+  for (int i = 0; i < NUM_WRITERS; i++)
+  {
+    pthread_join(writers[i], NULL);
+  }
+  pthread_join(scan, NULL);
+
+  // the hot band was split across more shards while the threads ran
+  assert(memcmp(boundaries, st->first, sizeof(boundaries)) != 0);
+
+  const size_t n = sharded_rbtree_size(st);
+  key_t *keys = calloc(n + 1, sizeof(key_t));
+  assert(sharded_rbtree_to_array(st, keys, n + 1) == n);
+  size_t evens = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    assert(i == 0 || keys[i - 1] <= keys[i]);
+    evens += ((long long)keys[i] % 2 == 0);
+  }
+  assert(evens == SHARD_KEY_SPACE / 2);
+  free(keys);
+
+  delete_sharded_rbtree(st);
+}
+
+int main(void)
+{
+  ct = new_concurrent_rbtree();
+  assert(ct != NULL);
+  for (key_t key = 0; key < KEY_SPACE; key += 2)
+  {
+    assert(concurrent_rbtree_insert(ct, key) == 0);
+  }
+
+  pthread_t readers[NUM_READERS], writers[NUM_WRITERS], check;
+  for (size_t i = 0; i < NUM_WRITERS; i++)
+  {
+    pthread_create(&writers[i], NULL, writer, (void *)(i + 1));
+  }
+  for (size_t i = 0; i < NUM_READERS; i++)
+  {
+    pthread_create(&readers[i], NULL, reader, (void *)(i + 101));
+  }
+  pthread_create(&check, NULL, checker, NULL);
+
+  for (int i = 0; i < NUM_READERS; i++)
+  {
+    pthread_join(readers[i], NULL);
+  }
+  for (int i = 0; i < NUM_WRITERS; i++)
+  {
+    pthread_join(writers[i], NULL);
+  }
+  pthread_join(check, NULL);
+  check_tree();
+
+  for (key_t key = 0; key < KEY_SPACE; key += 2)
+  {
+    assert(concurrent_rbtree_contains(ct, key));
+  }
+
+  delete_concurrent_rbtree(ct);
+
+  test_reclaim();
+  test_sharded();
+  test_snapshots();
+  printf("Passed all concurrent tests!\n");
+}
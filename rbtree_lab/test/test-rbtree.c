@@ -1,9 +1,30 @@
 #define SENTINEL
 #include <assert.h>
 #include <rbtree.h>
+#include <rbtree_compact.h>
+#include <rbtree_frozen.h>
+#include <rbtree_mmap.h>
+#include <rbtree_persist.h>
+#include <rbtree_sharded.h>
+#include <rbtree_wal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// split/join, node pools and saved files exist only in the rbtree.c engine
+#if !defined(RBTREE_FAT) && !defined(RBTREE_TOPDOWN)
+#define RB_CORE
+#endif
+
+// number of keys a node stands for
+#ifdef RBTREE_MULTISET
+#define KEY_COUNT(p) ((p)->count)
+#else
+#define KEY_COUNT(p) 1
+#endif
 
 // new_rbtree should return rbtree struct with null root node
 void test_init(void)
@@ -12,7 +33,11 @@ void test_init(void)
   assert(t != NULL);
 #ifdef SENTINEL
   assert(t->nil != NULL);
+#ifdef RBTREE_FAT
+  assert(t->root == NULL);
+#else
   assert(t->root == t->nil);
+#endif
 #else
   assert(t->root == NULL);
 #endif
@@ -25,14 +50,21 @@ void test_insert_single(const key_t key)
   rbtree *t = new_rbtree();
   node_t *p = rbtree_insert(t, key);
   assert(p != NULL);
-  assert(t->root == p);
   assert(p->key == key);
+#ifdef RBTREE_FAT
+  assert(t->root == p->leaf);
+  assert(t->root->leaf && t->root->count == 1);
+  assert(t->root->items[0] == p);
+#elif defined(SENTINEL)
+  assert(t->root == p);
   // assert(p->color == RBTREE_BLACK);  // color of root node should be black
-#ifdef SENTINEL
   assert(p->left == t->nil);
   assert(p->right == t->nil);
+#ifndef RBTREE_TOPDOWN
   assert(p->parent == t->nil);
+#endif
 #else
+  assert(t->root == p);
   assert(p->left == NULL);
   assert(p->right == NULL);
   assert(p->parent == NULL);
@@ -63,11 +95,16 @@ void test_erase_root(const key_t key)
   rbtree *t = new_rbtree();
   node_t *p = rbtree_insert(t, key);
   assert(p != NULL);
+#ifndef RBTREE_FAT
   assert(t->root == p);
+#endif
   assert(p->key == key);
 
   rbtree_erase(t, p);
-#ifdef SENTINEL
+#ifdef RBTREE_FAT
+  assert(t->root == NULL);
+  assert(rbtree_min(t) == t->nil);
+#elif defined(SENTINEL)
   assert(t->root == t->nil);
 #else
   assert(t->root == NULL);
@@ -113,7 +150,7 @@ void test_minmax(key_t *arr, const size_t n)
 
   insert_arr(t, arr, n);
   assert(t->root != NULL);
-#ifdef SENTINEL
+#if defined(SENTINEL) && !defined(RBTREE_FAT)
   assert(t->root != t->nil);
 #endif
 
@@ -196,6 +233,7 @@ void test_multi_instance()
   delete_rbtree(t1);
 }
 
+#ifndef RBTREE_FAT
 // Search tree constraint
 // The values of left subtree should be less than or equal to the current node
 // The values of right subtree should be greater than or equal to the current
@@ -298,6 +336,101 @@ void test_color_constraint(const rbtree *t)
   init_color_traverse();
   assert(color_traverse(p, RBTREE_BLACK, 0, nil));
 }
+#else
+// B+ tree constraints for the fat node engine
+// 1. Keys inside a node are sorted and lie within the separators of the parent.
+// 2. Every node but the root holds at least FAT_MIN keys.
+// 3. All leaves are at the same depth.
+// 4. Parent, leaf and sibling links agree with the tree shape.
+
+int leaf_depth = -1;
+
+static bool fat_traverse(const fat_node_t *p, const fat_node_t *parent,
+                         const key_t *lo, const key_t *hi, const int depth)
+{
+  if (p->parent != parent || p->count > (int)FAT_KEYS)
+  {
+    return false;
+  }
+  if (parent != NULL && p->count < (int)FAT_MIN)
+  {
+    return false;
+  }
+  for (int i = 0; i < p->count; i++)
+  {
+    if ((i > 0 && p->keys[i - 1] > p->keys[i]) || (lo != NULL && p->keys[i] < *lo) ||
+        (hi != NULL && p->keys[i] > *hi))
+    {
+      return false;
+    }
+  }
+  if (p->leaf)
+  {
+    if (leaf_depth < 0)
+    {
+      leaf_depth = depth;
+    }
+    for (int i = 0; i < p->count; i++)
+    {
+      if (p->items[i]->leaf != p || p->items[i]->key != p->keys[i])
+      {
+        return false;
+      }
+    }
+    return depth == leaf_depth;
+  }
+  for (int i = 0; i <= p->count; i++)
+  {
+    const key_t *clo = i > 0 ? &p->keys[i - 1] : lo;
+    const key_t *chi = i < p->count ? &p->keys[i] : hi;
+    if (!fat_traverse(p->children[i], p, clo, chi, depth + 1))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void test_search_constraint(const rbtree *t)
+{
+  assert(t != NULL);
+  if (t->root == NULL)
+  {
+    return;
+  }
+  assert(t->root->count > 0);
+  leaf_depth = -1;
+  assert(fat_traverse(t->root, NULL, NULL, NULL, 0));
+}
+
+// leaves should form one sorted list in both directions
+void test_color_constraint(const rbtree *t)
+{
+  assert(t != NULL);
+  if (t->root == NULL)
+  {
+    return;
+  }
+  const fat_node_t *p = t->root;
+  while (!p->leaf)
+  {
+    p = p->children[0];
+  }
+  assert(p->prev == NULL);
+  for (; p != NULL; p = p->next)
+  {
+    if (p->next != NULL)
+    {
+      assert(p->next->prev == p);
+      assert(p->keys[p->count - 1] <= p->next->keys[0]);
+    }
+    else
+    {
+      assert(p->items[p->count - 1] == rbtree_max(t));
+    }
+  }
+}
+#endif
 
 // rbtree should keep search tree and color constraints
 void test_rb_constraints(const key_t arr[], const size_t n)
@@ -413,18 +546,1630 @@ void test_find_erase_rand(const size_t n, const unsigned int seed)
   delete_rbtree(t);
 }
 
-int main(void)
+static int comp_ptr(const void *p1, const void *p2)
 {
-  test_init();
-  test_insert_single(1024);
-  test_find_single(512, 1024);
-  test_erase_root(128);
-  test_find_erase_fixed();
-  test_minmax_suite();
-  test_to_array_suite();
-  test_distinct_values();
-  test_duplicate_values();
-  test_multi_instance();
-  test_find_erase_rand(10000, 17);
+  const uintptr_t a = (uintptr_t) * (node_t *const *)p1;
+  const uintptr_t b = (uintptr_t) * (node_t *const *)p2;
+  return (a > b) - (a < b);
+}
+
+// erasing one handle among many equal keys should leave every other handle intact
+void test_erase_handles(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  rbtree *t = new_rbtree();
+  node_t **live = calloc(n, sizeof(node_t *));
+  node_t **seen = calloc(n, sizeof(node_t *));
+  node_t **sorted = calloc(n, sizeof(node_t *));
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    live[m++] = rbtree_insert(t, rand() % 16);
+  }
+
+  while (m > 0)
+  {
+    for (size_t r = 0; r < 7 && m > 0; r++)
+    {
+      const size_t i = rand() % m;
+      assert(rbtree_erase(t, live[i]) == 0);
+      live[i] = live[--m];
+    }
+    test_color_constraint(t);
+    test_search_constraint(t);
+
+    // the tree holds exactly the surviving handles, in key order
+    size_t k = 0;
+    for (rbtree_cursor c = rbtree_cursor_first(t); rbtree_cursor_valid(&c); rbtree_cursor_next(&c))
+    {
+      assert(k < m);
+      assert(k == 0 || !(c.node->key < seen[k - 1]->key));
+      seen[k++] = c.node;
+    }
+    assert(k == m);
+    qsort(seen, m, sizeof(node_t *), comp_ptr);
+    memcpy(sorted, live, m * sizeof(node_t *));
+    qsort(sorted, m, sizeof(node_t *), comp_ptr);
+    assert(memcmp(sorted, seen, m * sizeof(node_t *)) == 0);
+  }
+  assert(rbtree_min(t) == t->nil);
+
+  free(sorted);
+  free(seen);
+  free(live);
+  delete_rbtree(t);
+}
+
+// cached min/max should match a walk down from the root
+static void check_bounds(const rbtree *t)
+{
+#ifndef RBTREE_FAT
+  const node_t *lo = t->root, *hi = t->root;
+  while (lo != t->nil && lo->left != t->nil)
+    lo = lo->left;
+  while (hi != t->nil && hi->right != t->nil)
+    hi = hi->right;
+  assert(rbtree_min(t) == lo && rbtree_max(t) == hi);
+#endif
+}
+
+// size, min and max should track every insert and erase
+void test_size(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  rbtree *t = new_rbtree();
+  assert(rbtree_size(t) == 0 && rbtree_min(t) == t->nil && rbtree_max(t) == t->nil);
+
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *res = calloc(n, sizeof(key_t));
+  size_t m = 0;
+  for (size_t i = 0; i < 4 * n; i++)
+  {
+    const key_t key = rand() % n;
+    node_t *p = rbtree_find(t, key);
+    if (m < n && (p == t->nil || rand() % 2))
+    {
+      rbtree_insert(t, key);
+      m++;
+    }
+    else if (p != t->nil)
+    {
+      rbtree_erase(t, p);
+      m--;
+    }
+    assert(rbtree_size(t) == m);
+    check_bounds(t);
+    if (m > 0 && i % 64 == 0)
+    {
+      assert(rbtree_to_array(t, res, n) == m);
+      assert(rbtree_min(t)->key == res[0] && rbtree_max(t)->key == res[m - 1]);
+    }
+  }
+  while (m > 0)
+  {
+    rbtree_erase(t, rbtree_max(t));
+    assert(rbtree_size(t) == --m);
+    check_bounds(t);
+  }
+  assert(rbtree_min(t) == t->nil && rbtree_max(t) == t->nil);
+  delete_rbtree(t);
+
+  for (size_t i = 0; i < n; i++)
+    arr[i] = i / 3;
+  t = rbtree_from_sorted_array(arr, n);
+  assert(rbtree_size(t) == n);
+  assert(rbtree_min(t)->key == arr[0] && rbtree_max(t)->key == arr[n - 1]);
+  check_bounds(t);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+#ifdef RB_CORE
+// erased nodes should be recycled by the tree's node pool
+void test_node_reuse(void)
+{
+  rbtree *t = new_rbtree();
+  assert(t != NULL);
+
+  node_t *p = rbtree_insert(t, 10);
+  rbtree_insert(t, 20);
+  rbtree_erase(t, p);
+  node_t *q = rbtree_insert(t, 30);
+  assert(q == p);
+  assert(q->key == 30);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // delete_node should hand a whole subtree back to the pool
+  for (int i = 0; i < 1000; i++)
+  {
+    rbtree_insert(t, i);
+  }
+  node_slab_t *slabs = t->pool->slabs;
+  delete_node(t, t->root);
+  t->root = t->nil;
+  for (int i = 0; i < 1002; i++)
+  {
+    rbtree_insert(t, i);
+  }
+  assert(t->pool->slabs == slabs);
+
+  delete_rbtree(t);
+}
+#endif
+
+// bulk-loaded trees should satisfy the same constraints as inserted ones
+void test_from_sorted_array(const size_t n)
+{
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++)
+  {
+    arr[i] = rand() % 1000;
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  rbtree *t = rbtree_from_sorted_array(arr, n);
+  assert(t != NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  assert(rbtree_to_array(t, res, n) == n);
+  for (int i = 0; i < n; i++)
+  {
+    assert(arr[i] == res[i]);
+  }
+
+  // the tree should stay valid under further updates
+  rbtree_insert(t, 500);
+  if (n > 0)
+  {
+    rbtree_erase(t, rbtree_min(t));
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+void test_from_array_suite()
+{
+  for (size_t n = 0; n < 70; n++)
+  {
+    test_from_sorted_array(n);
+  }
+  test_from_sorted_array(10000);
+
+  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  rbtree *t = rbtree_from_array(entries, n);
+  assert(t != NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  qsort((void *)entries, n, sizeof(key_t), comp);
+  key_t res[sizeof(entries) / sizeof(entries[0])];
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++)
+  {
+    assert(entries[i] == res[i]);
+  }
+  delete_rbtree(t);
+}
+
+// cursors should visit every key in order, in both directions
+void test_cursor(const key_t *arr, const size_t n)
+{
+  rbtree *t = new_rbtree();
+  assert(t != NULL);
+  insert_arr(t, arr, n);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+
+  size_t i = 0;
+  for (rbtree_cursor c = rbtree_cursor_first(t); rbtree_cursor_valid(&c); rbtree_cursor_next(&c))
+  {
+    assert(i < n);
+    assert(c.node->key == res[i]);
+    i += KEY_COUNT(c.node);
+  }
+  assert(i == n);
+
+  for (rbtree_cursor c = rbtree_cursor_last(t); rbtree_cursor_valid(&c); rbtree_cursor_prev(&c))
+  {
+    assert(i > 0);
+    i -= KEY_COUNT(c.node);
+    assert(c.node->key == res[i]);
+  }
+  assert(i == 0);
+
+  // a partial fill should stop after n keys
+  if (n > 1)
+  {
+    key_t *part = calloc(n - 1, sizeof(key_t));
+    assert(rbtree_to_array(t, part, n - 1) == n - 1);
+    for (i = 0; i < n - 1; i++)
+    {
+      assert(part[i] == res[i]);
+    }
+    free(part);
+  }
+
+  free(res);
+  delete_rbtree(t);
+}
+
+void test_cursor_suite()
+{
+  const key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  test_cursor(entries, n);
+
+  rbtree *t = new_rbtree();
+  rbtree_cursor c = rbtree_cursor_first(t);
+  assert(!rbtree_cursor_valid(&c));
+  delete_rbtree(t);
+}
+
+// batched lookups should return exactly what rbtree_find returns
+void test_find_batch(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *keys = calloc(n, sizeof(key_t));
+  node_t **out = calloc(n, sizeof(node_t *));
+  for (int i = 0; i < n; i++)
+  {
+    rbtree_insert(t, rand() % n);
+    keys[i] = rand() % (2 * n);
+  }
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    size_t found = rbtree_find_batch(t, keys, n, out);
+    size_t expect = 0;
+    for (int i = 0; i < n; i++)
+    {
+      assert(out[i] == rbtree_find(t, keys[i]));
+      expect += (out[i] != t->nil);
+    }
+    assert(found == expect);
+    // the second pass runs the sorted path
+    qsort((void *)keys, n, sizeof(key_t), comp);
+  }
+
+  free(out);
+  free(keys);
+  delete_rbtree(t);
+}
+
+typedef struct
+{
+  key_t *keys;
+  size_t n;
+  size_t limit;
+} range_ctx;
+
+static int collect_key(node_t *node, void *ctx)
+{
+  range_ctx *rc = (range_ctx *)ctx;
+  for (size_t i = 0; i < KEY_COUNT(node); i++)
+  {
+    rc->keys[rc->n++] = node->key;
+  }
+  return rc->n >= rc->limit;
+}
+
+// bounds and range scans should agree with a linear scan of the sorted keys
+void test_range_suite()
+{
+  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  rbtree *t = new_rbtree();
+  insert_arr(t, entries, n);
+  qsort((void *)entries, n, sizeof(key_t), comp);
+
+  for (key_t k = 0; k < 1000; k++)
+  {
+    size_t lb = 0, ub = 0;
+    while (lb < n && entries[lb] < k)
+      lb++;
+    while (ub < n && entries[ub] <= k)
+      ub++;
+
+    node_t *p = rbtree_lower_bound(t, k);
+    assert(lb == n ? p == t->nil : p->key == entries[lb]);
+    node_t *q = rbtree_upper_bound(t, k);
+    assert(ub == n ? q == t->nil : q->key == entries[ub]);
+  }
+
+  key_t res[sizeof(entries) / sizeof(entries[0])];
+  range_ctx rc = {res, 0, n};
+#ifdef RBTREE_MULTISET
+  assert(rbtree_range(t, 8, 36, collect_key, &rc) == 7);  // both 24s share a node
+#else
+  assert(rbtree_range(t, 8, 36, collect_key, &rc) == 8);
+#endif
+  assert(rc.n == 8);
+  for (size_t i = 0; i < rc.n; i++)
+  {
+    assert(res[i] == entries[i + 2]);
+  }
+
+  // the callback can stop the scan early
+  rc.n = 0;
+  rc.limit = 3;
+  assert(rbtree_range(t, 0, 1000, collect_key, &rc) == 3);
+  assert(res[0] == 2 && res[1] == 5 && res[2] == 8);
+
+  rc.n = 0;
+  assert(rbtree_range(t, 40, 60, collect_key, &rc) == 0);
+
+  delete_rbtree(t);
+}
+
+#ifdef RBTREE_ORDER_STAT
+static size_t size_traverse(const node_t *p, const node_t *nil)
+{
+  if (p == nil)
+  {
+    return 0;
+  }
+  size_t size = size_traverse(p->left, nil) + size_traverse(p->right, nil) + KEY_COUNT(p);
+  assert(p->size == size);
+  return size;
+}
+
+// subtree sizes should survive rotations and power rank/select
+void test_order_stat(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++)
+  {
+    arr[i] = rand() % (n / 2 + 1);
+    rbtree_insert(t, arr[i]);
+  }
+  size_traverse(t->root, t->nil);
+
+  for (int i = 0; i < n; i += 2)
+  {
+    rbtree_erase(t, rbtree_find(t, arr[i]));
+  }
+  size_traverse(t->root, t->nil);
+
+  const size_t m = n / 2;
+  key_t *res = calloc(m, sizeof(key_t));
+  assert(rbtree_to_array(t, res, m) == m);
+  for (size_t k = 0; k < m; k++)
+  {
+    assert(rbtree_select(t, k)->key == res[k]);
+    size_t below = 0;
+    while (below < m && res[below] < res[k])
+      below++;
+    assert(rbtree_rank(t, res[k]) == below);
+  }
+  assert(rbtree_select(t, m) == t->nil);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+#endif
+
+#ifdef RBTREE_INTERVAL
+// check max_hi against the subtree and store it in *max (false for an empty subtree)
+static bool max_traverse(const node_t *p, const node_t *nil, key_t *max)
+{
+  if (p == nil)
+  {
+    return false;
+  }
+  assert(!(p->hi < p->key));
+  key_t expect = p->hi, child;
+  if (max_traverse(p->left, nil, &child) && expect < child)
+    expect = child;
+  if (max_traverse(p->right, nil, &child) && expect < child)
+    expect = child;
+  assert(p->max_hi == expect);
+  *max = expect;
+  return true;
+}
+
+typedef struct
+{
+  const node_t **nodes;
+  size_t n, limit;
+} overlap_ctx;
+
+static int collect_node(node_t *node, void *ctx)
+{
+  overlap_ctx *oc = (overlap_ctx *)ctx;
+  oc->nodes[oc->n++] = node;
+  return oc->n >= oc->limit;
+}
+
+// overlap queries should agree with a linear scan over the stored intervals
+void test_interval(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *los = calloc(n, sizeof(key_t));
+  key_t *his = calloc(n, sizeof(key_t));
+  bool *alive = calloc(n, sizeof(bool));
+  const node_t **nodes = calloc(n + 1, sizeof(node_t *));
+  key_t max;
+
+  assert(rbtree_insert_interval(t, 5, 4) == NULL);
+  for (size_t i = 0; i < n; i++)
+  {
+    // mostly short intervals with the odd long one spanning many others
+    los[i] = rand() % (4 * n);
+    his[i] = los[i] + (i % 50 == 0 ? rand() % n : rand() % 20);
+    assert(rbtree_insert_interval(t, los[i], his[i]) != NULL);
+    alive[i] = true;
+  }
+  max_traverse(t->root, t->nil, &max);
+
+  for (size_t i = 0; i < n; i += 3)
+  {
+    node_t *p = rbtree_lower_bound(t, los[i]);
+    while (p->hi != his[i])
+      p = rbtree_next(t, p);
+    assert(p->key == los[i]);
+    rbtree_erase(t, p);
+    alive[i] = false;
+  }
+  max_traverse(t->root, t->nil, &max);
+
+  for (int round = 0; round < 500; round++)
+  {
+    const key_t lo = rand() % (5 * n) - (key_t)(n / 2);
+    const key_t hi = lo + (round % 2 ? 0 : rand() % 60);
+    size_t expect = 0;
+    key_t first = lo;
+    for (size_t i = 0; i < n; i++)
+    {
+      if (alive[i] && !(hi < los[i]) && !(his[i] < lo))
+      {
+        if (expect == 0 || los[i] < first)
+          first = los[i];
+        expect++;
+      }
+    }
+
+    overlap_ctx oc = {nodes, 0, n + 1};
+    assert(rbtree_overlap_all(t, lo, hi, collect_node, &oc) == expect);
+    for (size_t i = 0; i < oc.n; i++)
+    {
+      assert(!(hi < nodes[i]->key) && !(nodes[i]->hi < lo));
+      assert(i == 0 || !(nodes[i]->key < nodes[i - 1]->key));
+    }
+
+    node_t *p = rbtree_overlap_first(t, lo, hi);
+    if (expect == 0)
+    {
+      assert(p == t->nil);
+    }
+    else
+    {
+      assert(p == nodes[0] && p->key == first);
+    }
+  }
+
+  // the callback can stop the scan early
+  overlap_ctx oc = {nodes, 0, 2};
+  assert(rbtree_overlap_all(t, 0, 4 * n, collect_node, &oc) == 2);
+
+  free(nodes);
+  free(alive);
+  free(his);
+  free(los);
+  delete_rbtree(t);
+}
+#endif
+
+// radix-sorted keys should match qsort, negative keys included
+void test_sort_keys(const unsigned int seed)
+{
+  srand(seed);
+  const size_t sizes[] = {0, 1, 2, 255, 256, 257, 5000, 5001};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    const size_t n = sizes[s];
+    key_t *arr = calloc(n + 1, sizeof(key_t));
+    key_t *expect = calloc(n + 1, sizeof(key_t));
+    for (size_t i = 0; i < n; i++)
+    {
+      // small keys leave the upper digits constant, so those passes are skipped
+      arr[i] = (s % 2) ? rand() % 1000 : rand() - RAND_MAX / 2;
+      expect[i] = arr[i];
+    }
+    qsort((void *)expect, n, sizeof(key_t), comp);
+    rbtree_sort_keys(arr, n);
+    assert(memcmp(arr, expect, n * sizeof(key_t)) == 0);
+    free(expect);
+    free(arr);
+  }
+}
+
+// remove one copy of each sorted batch key from the sorted keys in ref
+static size_t remove_batch(key_t *ref, const size_t m, const key_t *batch, const size_t k)
+{
+  size_t out = 0, j = 0;
+  for (size_t i = 0; i < m; i++)
+  {
+    while (j < k && batch[j] < ref[i])
+      j++;
+    if (j < k && batch[j] == ref[i])
+      j++;
+    else
+      ref[out++] = ref[i];
+  }
+  return out;
+}
+
+static void check_batch(const rbtree *t, const key_t *ref, const size_t m, key_t *res)
+{
+  test_color_constraint(t);
+  test_search_constraint(t);
+#ifdef RBTREE_ORDER_STAT
+  size_traverse(t->root, t->nil);
+#endif
+#ifdef RBTREE_INTERVAL
+  key_t max;
+  max_traverse(t->root, t->nil, &max);
+#endif
+  check_bounds(t);
+  assert(rbtree_size(t) == m);
+  assert(rbtree_to_array(t, res, m) == m);
+  assert(memcmp(res, ref, m * sizeof(key_t)) == 0);
+}
+
+// batched inserts and erases should leave the same keys as applying them one by one
+void test_batch(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *ref = calloc(4 * n, sizeof(key_t));
+  key_t *res = calloc(4 * n, sizeof(key_t));
+  key_t *batch = calloc(n, sizeof(key_t));
+  size_t m = 0;
+
+  // batches several times larger than the tree rebuild it, the others go one by one
+  const size_t sizes[] = {n / 10, n, 7, n / 50, n / 3, 1, n / 10};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    const size_t k = sizes[s];
+    node_t *keep = rbtree_max(t);
+    for (size_t i = 0; i < k; i++)
+    {
+      batch[i] = rand() % (n / 2);
+      ref[m + i] = batch[i];
+    }
+    assert(rbtree_insert_batch(t, batch, k) == k);
+    m += k;
+    qsort((void *)ref, m, sizeof(key_t), comp);
+    check_batch(t, ref, m, res);
+
+    // nodes already in the tree are kept, not copied
+    if (keep != t->nil)
+    {
+      node_t *p = rbtree_min(t);
+      while (p != t->nil && p != keep)
+        p = rbtree_next(t, p);
+      assert(p == keep);
+    }
+
+    for (size_t i = 0; i < k; i++)
+    {
+      batch[i] = rand() % n;
+    }
+    const size_t erased = rbtree_erase_batch(t, batch, k);
+    qsort((void *)batch, k, sizeof(key_t), comp);
+    const size_t left = remove_batch(ref, m, batch, k);
+    assert(erased == m - left);
+    m = left;
+    check_batch(t, ref, m, res);
+  }
+
+  // a batch much larger than the tree, with keys missing from it
+  key_t *big = calloc(5 * m + 1, sizeof(key_t));
+  for (size_t i = 0; i < 5 * m; i++)
+  {
+    big[i] = rand() % n;
+  }
+  const size_t erased = rbtree_erase_batch(t, big, 5 * m);
+  qsort((void *)big, 5 * m, sizeof(key_t), comp);
+  const size_t left = remove_batch(ref, m, big, 5 * m);
+  assert(erased == m - left);
+  m = left;
+  check_batch(t, ref, m, res);
+  free(big);
+
+  assert(rbtree_erase_batch(t, ref, m) == m);
+  assert(rbtree_size(t) == 0 && rbtree_min(t) == t->nil && rbtree_max(t) == t->nil);
+
+  free(batch);
+  free(res);
+  free(ref);
+  delete_rbtree(t);
+}
+
+// every shard should hold only keys of the slots it owns
+static void check_shards(const sharded_rbtree *st)
+{
+  assert(st->first[0] == 0 && st->first[st->nshards] == st->nslots);
+  for (int k = 0; k < st->nshards; k++)
+  {
+    const rbtree *t = st->shards[k].tree;
+    assert(rbtree_size(t) == st->shards[k].size);
+    assert(st->first[k] < st->first[k + 1]);
+    for (size_t slot = st->first[k]; slot < st->first[k + 1]; slot++)
+      assert(st->owner[slot] == k);
+    for (node_t *p = rbtree_min(t); p != t->nil; p = rbtree_next(t, p))
+    {
+      const size_t slot = sharded_rbtree_slot(st, p->key);
+      assert(st->first[k] <= slot && slot < st->first[k + 1]);
+    }
+  }
+}
+
+static void check_sharded(sharded_rbtree *st, const key_t *ref, const size_t m, key_t *res)
+{
+  check_shards(st);
+  assert(sharded_rbtree_size(st) == m);
+  assert(sharded_rbtree_to_array(st, res, m + 1) == m);
+  assert(memcmp(res, ref, m * sizeof(key_t)) == 0);
+
+  key_t lo, hi;
+  assert(sharded_rbtree_min(st, &lo) == (m > 0 ? 0 : -1));
+  assert(sharded_rbtree_max(st, &hi) == (m > 0 ? 0 : -1));
+  if (m > 0)
+    assert(lo == ref[0] && hi == ref[m - 1]);
+}
+
+// a sharded tree should behave like one tree and split shards that grow hot
+void test_sharded(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  sharded_rbtree *st = new_sharded_rbtree(4, 0, n - 1);
+  assert(st != NULL && st->nshards == 4);
+  key_t *ref = calloc(2 * n, sizeof(key_t));
+  key_t *res = calloc(2 * n + 1, sizeof(key_t));
+  size_t m = 0;
+  check_sharded(st, ref, m, res);
+
+  // every key lands in the first shard until it splits
+  const size_t initial = st->first[1];
+  for (size_t i = 0; i < n; i++)
+  {
+    ref[m] = rand() % (n / 8);
+    assert(sharded_rbtree_insert(st, ref[m++]) == 0);
+  }
+  assert(st->first[1] != initial);
+  size_t biggest = 0;
+  for (int k = 0; k < st->nshards; k++)
+  {
+    if (st->shards[k].size > biggest)
+      biggest = st->shards[k].size;
+  }
+  assert(biggest < m / 2);
+
+  // then spread them out, some outside the hinted range
+  for (size_t i = 0; i < n; i++)
+  {
+    ref[m] = (key_t)(rand() % (n + n / 4)) - (key_t)(n / 8);
+    assert(sharded_rbtree_insert(st, ref[m++]) == 0);
+  }
+  qsort((void *)ref, m, sizeof(key_t), comp);
+  check_sharded(st, ref, m, res);
+
+  for (size_t i = 0; i < 1000; i++)
+  {
+    const key_t key = (key_t)(rand() % (n + n / 4)) - (key_t)(n / 8);
+    key_t *hit = bsearch(&key, ref, m, sizeof(key_t), comp);
+    assert(sharded_rbtree_contains(st, key) == (hit != NULL));
+  }
+
+  // ranges cross shard boundaries and stop when asked
+  for (size_t i = 0; i < 200; i++)
+  {
+    const key_t lo = (key_t)(rand() % (n + n / 4)) - (key_t)(n / 8);
+    const key_t hi = lo + rand() % (n / 2);
+    size_t first = 0;
+    while (first < m && ref[first] < lo)
+      first++;
+    size_t last = first;
+    while (last < m && ref[last] < hi)
+      last++;
+
+    const size_t expect = last - first;
+    const size_t limit = (i % 2) ? expect / 2 + 1 : m + 1;
+    range_ctx c = {res, 0, limit};
+    const size_t count = sharded_rbtree_range(st, lo, hi, collect_key, &c);
+    assert(c.n <= expect && (limit <= expect ? c.n >= limit : c.n == expect));
+    assert(memcmp(res, ref + first, c.n * sizeof(key_t)) == 0);
+#ifndef RBTREE_MULTISET
+    assert(count == c.n);
+#else
+    assert(count <= c.n);
+#endif
+  }
+
+  // erase every other key, then one that is no longer there
+  size_t kept = 0;
+  for (size_t i = 0; i < m; i++)
+  {
+    if (i % 2)
+      assert(sharded_rbtree_erase(st, ref[i]) == 0);
+    else
+      ref[kept++] = ref[i];
+  }
+  m = kept;
+  check_sharded(st, ref, m, res);
+  assert(sharded_rbtree_erase(st, (key_t)(2 * n)) == -1);
+
+  for (size_t i = 0; i < m; i++)
+    assert(sharded_rbtree_erase(st, ref[i]) == 0);
+  check_sharded(st, ref, 0, res);
+
+  free(res);
+  free(ref);
+  delete_sharded_rbtree(st);
+}
+
+#ifdef RBTREE_VALUE_TYPE
+// values should stay attached to their keys through rebalancing
+void test_values(const size_t n)
+{
+  rbtree *t = new_rbtree();
+  for (int i = 0; i < n; i++)
+  {
+    node_t *p = rbtree_insert_value(t, (key_t)(i * 7 % n), (value_t)(intptr_t)i);
+    assert(p != NULL);
+  }
+  for (int i = 0; i < n; i += 3)
+  {
+    rbtree_erase(t, rbtree_find(t, (key_t)(i * 7 % n)));
+  }
+  for (int i = 0; i < n; i++)
+  {
+    node_t *p = rbtree_find(t, (key_t)(i * 7 % n));
+    if (i % 3 == 0)
+    {
+      assert(p == t->nil);
+    }
+    else
+    {
+      assert(p != t->nil);
+      assert(p->value == (value_t)(intptr_t)i);
+    }
+  }
+
+  // nodes not made by rbtree_insert_value start out zeroed, even when they
+  // reuse the node of an erased key
+  for (int i = 0; i < n; i += 3)
+  {
+    node_t *p = rbtree_insert(t, (key_t)(i * 7 % n));
+    assert(p != NULL && p->value == (value_t)0);
+  }
+  key_t keys[] = {1, 2, 3, 5, 8};
+  rbtree *b = rbtree_from_sorted_array(keys, 5);
+  for (node_t *p = rbtree_min(b); p != b->nil; p = rbtree_next(b, p))
+    assert(p->value == (value_t)0);
+  delete_rbtree(b);
+  delete_rbtree(t);
+}
+#endif
+
+#ifdef RBTREE_MULTISET
+static size_t node_count(const rbtree *t)
+{
+  size_t nodes = 0;
+  for (node_t *p = rbtree_min(t); p != t->nil; p = rbtree_next(t, p))
+    nodes++;
+  return nodes;
+}
+
+// equal keys should share one counted node in every way a tree is built
+void test_multiset(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  const size_t space = n / 10 + 1;
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *res = calloc(2 * n, sizeof(key_t));
+  rbtree *t = new_rbtree();
+  for (int i = 0; i < n; i++)
+  {
+    arr[i] = rand() % space;
+    node_t *p = rbtree_find(t, arr[i]);
+    size_t before = (p == t->nil) ? 0 : p->count;
+    node_t *q = rbtree_insert(t, arr[i]);
+    assert(p == t->nil || q == p);
+    assert(q->count == before + 1);
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  size_t distinct = 0;
+  for (size_t i = 0; i < n; i++)
+    distinct += (i == 0 || arr[i] != arr[i - 1]);
+
+  // to_array expands the counts back into repeated keys
+  assert(node_count(t) == distinct);
+  assert(rbtree_to_array(t, res, 2 * n) == n);
+  assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // erase drops one copy and keeps the node until the last one goes
+  node_t *p = rbtree_find(t, arr[n / 2]);
+  const size_t copies = p->count;
+  for (size_t c = copies; c > 1; c--)
+  {
+    assert(rbtree_erase(t, p) == 0);
+    assert(rbtree_find(t, arr[n / 2]) == p && p->count == c - 1);
+  }
+  assert(rbtree_erase(t, p) == 0);
+  assert(rbtree_find(t, arr[n / 2]) == t->nil);
+  assert(node_count(t) == distinct - 1);
+  test_color_constraint(t);
+  delete_rbtree(t);
+
+  // bulk loading collapses runs of equal keys
+  t = rbtree_from_sorted_array(arr, n);
+  assert(node_count(t) == distinct);
+  assert(rbtree_to_array(t, res, 2 * n) == n);
+  assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // joining on a key already at the edge merges it into one node
+  const key_t mid = arr[n / 2];
+  rbtree *lo, *hi;
+  assert(rbtree_split(t, mid, &lo, &hi) == 0);
+  t = rbtree_join(lo, mid, hi);
+  assert(node_count(t) == distinct);
+  assert(rbtree_find(t, mid)->count == copies + 1);
+  assert(rbtree_to_array(t, res, 2 * n) == n + 1);
+  test_color_constraint(t);
+
+  // union keeps the larger count of equal keys, so a tree united with its
+  // copy is unchanged
+  rbtree *u = rbtree_union(rbtree_from_sorted_array(arr, n), rbtree_from_sorted_array(arr, n));
+  assert(node_count(u) == distinct);
+  assert(rbtree_size(u) == n);
+  assert(rbtree_to_array(u, res, 2 * n) == n);
+  assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  test_color_constraint(u);
+  test_search_constraint(u);
+
+  free(res);
+  free(arr);
+  delete_rbtree(u);
+  delete_rbtree(t);
+}
+#endif
+
+#ifdef RBTREE_STATS
+typedef struct
+{
+  size_t events[RBTREE_EV_SLAB + 1];
+  uint64_t compares;
+} trace_ctx;
+
+static void count_event(rbtree_event_t ev, const rbtree *t, const node_t *node, uint64_t arg,
+                        void *ctx)
+{
+  trace_ctx *tc = (trace_ctx *)ctx;
+  tc->events[ev]++;
+  if (ev == RBTREE_EV_FIND)
+  {
+    tc->compares += arg;
+  }
+}
+
+// counters and trace hooks should agree with each other and with the tree shape
+void test_stats(const size_t n)
+{
+  trace_ctx tc;
+  memset(&tc, 0, sizeof(tc));
+  rbtree_set_trace(count_event, &tc);
+
+  rbtree *t = new_rbtree();
+  for (int i = 0; i < n; i++)
+  {
+    rbtree_insert(t, i);
+  }
+  rbtree_stats_t s = rbtree_stats(t);
+  assert(s.nodes == n);
+  assert(s.rotations > 0 && s.insert_fixups > 0 && s.erase_fixups == 0);
+  assert(s.black_height == black_height(t, t->root));
+  assert(s.height >= s.black_height && s.height <= 2 * s.black_height);
+  assert(s.bytes >= n * sizeof(node_t));
+  assert(tc.events[RBTREE_EV_INSERT] == n);
+  assert(tc.events[RBTREE_EV_ROTATE] == s.rotations);
+  assert(tc.events[RBTREE_EV_SLAB] > 0);
+
+  for (int i = 0; i < n; i++)
+  {
+    assert(rbtree_find(t, i) != t->nil);
+  }
+  s = rbtree_stats(t);
+  assert(s.finds == n && tc.events[RBTREE_EV_FIND] == n);
+  assert(s.find_compares == tc.compares);
+  assert(s.find_compares >= n && s.find_compares <= n * s.height);
+
+  for (int i = 0; i < n; i += 2)
+  {
+    rbtree_erase(t, rbtree_find(t, i));
+  }
+  s = rbtree_stats(t);
+  assert(s.nodes == n - (n + 1) / 2);
+  assert(s.erase_fixups > 0);
+  assert(tc.events[RBTREE_EV_ERASE] == (n + 1) / 2);
+  assert(tc.events[RBTREE_EV_ROTATE] == s.rotations);
+
+  rbtree_set_trace(NULL, NULL);
+  rbtree_insert(t, -1);
+  assert(tc.events[RBTREE_EV_INSERT] == n);
+
+  rbtree *e = new_rbtree();
+  s = rbtree_stats(e);
+  assert(s.nodes == 0 && s.height == 0 && s.black_height == 0 && s.rotations == 0);
+
+  delete_rbtree(e);
+  delete_rbtree(t);
+}
+#endif
+
+static int compact_black_height(const compact_rbtree *t, const cnode_id p,
+                                const color_t parent_color)
+{
+  if (p == COMPACT_NIL)
+  {
+    return 0;
+  }
+  const color_t color = compact_color(t, p);
+  assert(!(parent_color == RBTREE_RED && color == RBTREE_RED));
+  const cnode_id l = t->nodes[p].left, r = t->nodes[p].right;
+  if (l != COMPACT_NIL)
+  {
+    assert(compact_parent(t, l) == p);
+    assert(t->nodes[l].key <= t->nodes[p].key);
+  }
+  if (r != COMPACT_NIL)
+  {
+    assert(compact_parent(t, r) == p);
+    assert(t->nodes[r].key >= t->nodes[p].key);
+  }
+  const int lh = compact_black_height(t, l, color);
+  assert(lh == compact_black_height(t, r, color));
+  return lh + (color == RBTREE_BLACK ? 1 : 0);
+}
+
+// the compact index-linked layout should behave like the pointer tree
+void test_compact(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  compact_rbtree *t = new_compact_rbtree();
+  rbtree *ref = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++)
+  {
+    arr[i] = rand() % (n / 2 + 1);
+    assert(compact_rbtree_insert(t, arr[i]) != COMPACT_NIL);
+    rbtree_insert(ref, arr[i]);
+  }
+  assert(compact_color(t, t->root) == RBTREE_BLACK);
+  compact_black_height(t, t->root, RBTREE_BLACK);
+
+  for (int i = 0; i < n; i += 2)
+  {
+    cnode_id p = compact_rbtree_find(t, arr[i]);
+    assert(p != COMPACT_NIL && t->nodes[p].key == arr[i]);
+    assert(compact_rbtree_erase(t, p) == 0);
+    rbtree_erase(ref, rbtree_find(ref, arr[i]));
+  }
+  compact_black_height(t, t->root, RBTREE_BLACK);
+  assert(t->nodes[compact_rbtree_min(t)].key == rbtree_min(ref)->key);
+  assert(t->nodes[compact_rbtree_max(t)].key == rbtree_max(ref)->key);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  key_t *expect = calloc(n, sizeof(key_t));
+  const int m = compact_rbtree_to_array(t, res, n);
+  assert(m == rbtree_to_array(ref, expect, n));
+  for (int i = 0; i < m; i++)
+  {
+    assert(res[i] == expect[i]);
+  }
+
+  free(expect);
+  free(res);
+  free(arr);
+  delete_rbtree(ref);
+  delete_compact_rbtree(t);
+}
+
+#ifdef RB_CORE
+static void check_tree(const rbtree *t, const key_t *expect, const size_t n)
+{
+  test_color_constraint(t);
+  test_search_constraint(t);
+#ifdef RBTREE_ORDER_STAT
+  size_traverse(t->root, t->nil);
+#endif
+#ifdef RBTREE_INTERVAL
+  key_t max;
+  max_traverse(t->root, t->nil, &max);
+#endif
+  check_bounds(t);
+  assert(rbtree_size(t) == n);
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_to_array(t, res, n + 1) == n);
+  for (int i = 0; i < n; i++)
+  {
+    assert(res[i] == expect[i]);
+  }
+  free(res);
+}
+
+// split and join should produce valid trees holding the right keys
+void test_split_join(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++)
+  {
+    arr[i] = rand() % (n / 4 + 1);
+  }
+  rbtree *t = new_rbtree();
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  for (int round = 0; round < 20; round++)
+  {
+    const key_t pivot = rand() % (n / 4 + 2);
+    size_t cut = 0;
+    while (cut < n && arr[cut] < pivot)
+      cut++;
+
+    rbtree *lo, *hi;
+    assert(rbtree_split(t, pivot, &lo, &hi) == 0);
+    check_tree(lo, arr, cut);
+    check_tree(hi, arr + cut, n - cut);
+
+    // join them back with the pivot in the middle, then drop it again
+    t = rbtree_join(lo, pivot, hi);
+    assert(t != NULL);
+    rbtree_erase(t, rbtree_find(t, pivot));
+    check_tree(t, arr, n);
+  }
+
+  // trees from different pools can be joined too
+  rbtree *small = new_rbtree();
+  key_t big_keys[] = {2000000, 2000001, 2000002};
+  insert_arr(small, big_keys, 3);
+  t = rbtree_join(t, 1000000, small);
+  assert(t != NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+  assert(rbtree_max(t)->key == 2000002);
+  for (int i = 0; i < 1000; i++)
+  {
+    rbtree_insert(t, i);
+  }
+  test_color_constraint(t);
+
+  free(arr);
+  delete_rbtree(t);
+}
+
+static rbtree *tree_of(const key_t *arr, const size_t n)
+{
+  rbtree *t = new_rbtree();
+  insert_arr(t, arr, n);
+  return t;
+}
+
+static bool contains_key(const key_t *sorted, const size_t n, const key_t key)
+{
+  return bsearch(&key, sorted, n, sizeof(key_t), comp) != NULL;
+}
+
+// drops repeated keys from a sorted array, returns the new length
+static size_t unique_keys(key_t *arr, const size_t n)
+{
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++)
+    if (m == 0 || arr[m - 1] != arr[i])
+      arr[m++] = arr[i];
+  return m;
+}
+
+// set operations should match a merge over the sorted inputs
+void test_set_ops(const size_t n1, const size_t n2, const unsigned int seed)
+{
+  srand(seed);
+  key_t *a = calloc(n1, sizeof(key_t));
+  key_t *b = calloc(n2, sizeof(key_t));
+  for (int i = 0; i < n1; i++)
+    a[i] = rand() % (n1 + n2);
+  for (int i = 0; i < n2; i++)
+    b[i] = rand() % (n1 + n2);
+
+  rbtree *w = rbtree_union(tree_of(a, n1), tree_of(b, n2));
+  rbtree *x = rbtree_intersect(tree_of(a, n1), tree_of(b, n2));
+  rbtree *d = rbtree_difference(tree_of(a, n1), tree_of(b, n2));
+
+  qsort((void *)a, n1, sizeof(key_t), comp);
+  qsort((void *)b, n2, sizeof(key_t), comp);
+  key_t *expect = calloc(n1 + n2 + 1, sizeof(key_t));
+
+  // a key in both trees is kept once: the union of two sets is their
+  // merge without repeats
+  key_t *sa = calloc(n1 + 1, sizeof(key_t));
+  key_t *sb = calloc(n2 + 1, sizeof(key_t));
+  memcpy(sa, a, n1 * sizeof(key_t));
+  memcpy(sb, b, n2 * sizeof(key_t));
+  const size_t na = unique_keys(sa, n1), nb = unique_keys(sb, n2);
+  rbtree *u = rbtree_union(tree_of(sa, na), tree_of(sb, nb));
+  size_t m = 0;
+  for (size_t i = 0, j = 0; i < na || j < nb;)
+    expect[m++] = (j == nb || (i < na && sa[i] <= sb[j])) ? sa[i++] : sb[j++];
+  check_tree(u, expect, unique_keys(expect, m));
+
+  // with repeats inside a tree, a key in both keeps the copies of one tree
+  // (the larger count in a multiset)
+  const size_t wn = rbtree_size(w);
+  assert(rbtree_to_array(w, expect, wn) == wn);
+  size_t g = 0;
+  for (size_t i = 0, j = 0; i < n1 || j < n2;)
+  {
+    const key_t k = (j == n2 || (i < n1 && a[i] <= b[j])) ? a[i] : b[j];
+    size_t ca = 0, cb = 0, cg = 0;
+    for (; i < n1 && a[i] == k; i++)
+      ca++;
+    for (; j < n2 && b[j] == k; j++)
+      cb++;
+    for (; g < wn && expect[g] == k; g++)
+      cg++;
+#ifdef RBTREE_MULTISET
+    assert(cg == (ca > cb ? ca : cb));
+#else
+    assert(cg > 0 && (cg == ca || cg == cb));
+#endif
+  }
+  assert(g == wn);
+  test_color_constraint(w);
+
+  m = 0;
+  for (size_t i = 0; i < n1; i++)
+    if (contains_key(b, n2, a[i]))
+      expect[m++] = a[i];
+  check_tree(x, expect, m);
+
+  m = 0;
+  for (size_t i = 0; i < n1; i++)
+    if (!contains_key(b, n2, a[i]))
+      expect[m++] = a[i];
+  check_tree(d, expect, m);
+
+  // results are ordinary trees afterwards
+  rbtree_insert(d, 7);
+  rbtree_erase(d, rbtree_min(d));
+  test_color_constraint(d);
+
+  free(expect);
+  free(sb);
+  free(sa);
+  free(b);
+  free(a);
+  delete_rbtree(d);
+  delete_rbtree(x);
+  delete_rbtree(w);
+  delete_rbtree(u);
+}
+#endif
+
+// returns black height, or -1 if a left-leaning red-black rule is broken
+static int persist_black_height(const pnode_t *p, const key_t *lo, const key_t *hi)
+{
+  if (p == NULL)
+    return 0;
+  assert(p->refs >= 1);
+  if (lo != NULL)
+    assert(*lo <= p->key);
+  if (hi != NULL)
+    assert(p->key <= *hi);
+  // no red right links and no two reds in a row
+  assert(p->right == NULL || p->right->color == RBTREE_BLACK);
+  if (p->color == RBTREE_RED)
+    assert(p->left == NULL || p->left->color == RBTREE_BLACK);
+
+  int bl = persist_black_height(p->left, lo, &p->key);
+  int br = persist_black_height(p->right, &p->key, hi);
+  assert(bl == br);
+  return bl + (p->color == RBTREE_BLACK ? 1 : 0);
+}
+
+static void check_persist(const prbtree *t, const key_t *expect, const size_t n)
+{
+  assert(t->root == NULL || t->root->color == RBTREE_BLACK);
+  persist_black_height(t->root, NULL, NULL);
+
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(prbtree_to_array(t, res, n + 1) == n);
+  for (int i = 0; i < n; i++)
+    assert(res[i] == expect[i]);
+  free(res);
+}
+
+void test_persist(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++)
+    arr[i] = rand() % n;
+
+  prbtree *t = new_prbtree();
+  for (int i = 0; i < n; i++)
+    assert(prbtree_insert(t, arr[i]) == 0);
+
+  prbtree *snap = prbtree_snapshot(t);
+  assert(snap->root == t->root);
+
+  // mutate the live version: erase the first half, insert fresh keys
+  for (int i = 0; i < n / 2; i++)
+    assert(prbtree_erase(t, arr[i]) == 0);
+  for (int i = 0; i < n / 4; i++)
+    assert(prbtree_insert(t, n + i) == 0);
+  assert(prbtree_erase(t, 2 * n) == -1);
+  assert(prbtree_find(t, n) != NULL);
+  assert(prbtree_find(snap, n) == NULL);
+
+  // the snapshot still holds exactly the original keys
+  key_t *orig = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++)
+    orig[i] = arr[i];
+  qsort((void *)orig, n, sizeof(key_t), comp);
+  check_persist(snap, orig, n);
+  assert(prbtree_min(snap)->key == orig[0]);
+  assert(prbtree_max(snap)->key == orig[n - 1]);
+
+  key_t *live = calloc(n, sizeof(key_t));
+  size_t m = 0;
+  for (int i = n / 2; i < n; i++)
+    live[m++] = arr[i];
+  for (int i = 0; i < n / 4; i++)
+    live[m++] = n + i;
+  qsort((void *)live, m, sizeof(key_t), comp);
+  check_persist(t, live, m);
+
+  // versions are independent: drop the original, keep editing the snapshot
+  delete_prbtree(t);
+  prbtree *v2 = prbtree_snapshot(snap);
+  for (int i = 0; i < n; i++)
+    assert(prbtree_erase(snap, arr[i]) == 0);
+  assert(snap->root == NULL);
+  check_persist(v2, orig, n);
+
+  free(live);
+  free(orig);
+  free(arr);
+  delete_prbtree(v2);
+  delete_prbtree(snap);
+}
+
+#ifdef RB_CORE
+static int collect_mapped_key(const compact_node_t *node, void *ctx)
+{
+  range_ctx *rc = (range_ctx *)ctx;
+  rc->keys[rc->n++] = node->key;
+  return rc->n >= rc->limit;
+}
+
+// a saved tree should answer the same queries once mapped back
+void test_mmap(const size_t n, const unsigned int seed)
+{
+  char path[] = "/tmp/test-rbtree-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++)
+    arr[i] = rand() % (2 * n);
+  rbtree *t = new_rbtree();
+  insert_arr(t, arr, n);
+  assert(rbtree_save(t, path) == 0);
+
+  mmap_rbtree *m = rbtree_open_mmap(path);
+  assert(m != NULL);
+  assert(compact_color(&m->tree, m->tree.root) == RBTREE_BLACK);
+  compact_black_height(&m->tree, m->tree.root, RBTREE_BLACK);
+  key_t *res = calloc(n, sizeof(key_t));
+  key_t *expect = calloc(n, sizeof(key_t));
+  assert(compact_rbtree_to_array(&m->tree, res, n) == n);
+  assert(rbtree_to_array(t, expect, n) == n);
+  assert(memcmp(res, expect, n * sizeof(key_t)) == 0);
+  assert(mmap_rbtree_min(m)->key == rbtree_min(t)->key);
+  assert(mmap_rbtree_max(m)->key == rbtree_max(t)->key);
+  for (key_t k = 0; k < 2 * n; k++)
+  {
+    node_t *p = rbtree_find(t, k);
+    const compact_node_t *q = mmap_rbtree_find(m, k);
+    assert(p == t->nil ? q == NULL : q != NULL && q->key == k);
+  }
+
+  range_ctx rc = {res, 0, n};
+  size_t cnt = mmap_rbtree_range(m, n / 4, n, collect_mapped_key, &rc);
+  size_t i = 0;
+  for (node_t *p = rbtree_lower_bound(t, n / 4); p != t->nil && p->key < n; p = rbtree_next(t, p))
+    for (size_t c = 0; c < KEY_COUNT(p); c++)
+      assert(i < cnt && res[i++] == p->key);
+  assert(i == cnt);
+  rbtree_close_mmap(m);
+
+  // corrupt links (an index past the end and a cycle back to the root) must not
+  // make lookups read outside the mapping or loop forever
+  FILE *fp = fopen(path, "r+b");
+  compact_node_t node;
+  long first = sizeof(rbtree_file_header) + sizeof(compact_node_t);
+  fseek(fp, first, SEEK_SET);
+  assert(fread(&node, sizeof(node), 1, fp) == 1);
+  node.left = (cnode_id)(10 * n);
+  node.right = 1;
+  fseek(fp, first, SEEK_SET);
+  assert(fwrite(&node, sizeof(node), 1, fp) == 1);
+  fclose(fp);
+  m = rbtree_open_mmap(path);
+  assert(m != NULL);
+  mmap_rbtree_find(m, 2 * n);
+  mmap_rbtree_find(m, 0);
+  assert(mmap_rbtree_min(m) != NULL && mmap_rbtree_max(m) != NULL);
+  rc.n = 0;
+  assert(mmap_rbtree_range(m, 0, 2 * n, collect_mapped_key, &rc) <= n);
+  assert(mmap_rbtree_to_array(m, res, n) <= n);
+  rbtree_close_mmap(m);
+
+  // an empty tree round-trips too
+  rbtree *e = new_rbtree();
+  assert(rbtree_save(e, path) == 0);
+  m = rbtree_open_mmap(path);
+  assert(m != NULL);
+  assert(mmap_rbtree_min(m) == NULL && mmap_rbtree_find(m, 0) == NULL);
+  rbtree_close_mmap(m);
+
+  // a file that is not a saved tree is rejected
+  fp = fopen(path, "wb");
+  fputs("not a tree file, just some text padding it out", fp);
+  fclose(fp);
+  assert(rbtree_open_mmap(path) == NULL);
+  assert(rbtree_open_mmap("/nonexistent/rbtree.map") == NULL);
+
+  unlink(path);
+  free(expect);
+  free(res);
+  free(arr);
+  delete_rbtree(e);
+  delete_rbtree(t);
+}
+
+// the tree holds exactly the keys of ref
+static void check_same(const rbtree *t, const rbtree *ref, const size_t n)
+{
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  key_t *expect = calloc(n + 1, sizeof(key_t));
+  const int m = rbtree_to_array(ref, expect, n + 1);
+  assert(rbtree_to_array(t, res, n + 1) == m);
+  assert(memcmp(res, expect, m * sizeof(key_t)) == 0);
+  test_color_constraint(t);
+  free(expect);
+  free(res);
+}
+
+static void wal_random_ops(wal_rbtree *w, rbtree *ref, const size_t ops, const size_t space)
+{
+  for (size_t i = 0; i < ops; i++)
+  {
+    const key_t key = rand() % space;
+    node_t *p = rbtree_find(w->tree, key);
+    if (i % 3 == 0 && p != w->tree->nil)
+    {
+      assert(wal_rbtree_erase(w, p) == 0);
+      rbtree_erase(ref, rbtree_find(ref, key));
+    }
+    else
+    {
+      assert(wal_rbtree_insert(w, key) != NULL);
+      rbtree_insert(ref, key);
+    }
+  }
+}
+
+// drop records that were never synced, as a crash would
+static void wal_crash(wal_rbtree *w)
+{
+  w->pending = 0;
+  assert(wal_rbtree_close(w) == 0);
+}
+
+void test_wal(const size_t n, const unsigned int seed)
+{
+  char dir[] = "/tmp/test-rbtree-wal-XXXXXX";
+  assert(mkdtemp(dir) != NULL);
+  char base[64], snap[80], log[80];
+  snprintf(base, sizeof(base), "%s/db", dir);
+  snprintf(snap, sizeof(snap), "%s.snap", base);
+  snprintf(log, sizeof(log), "%s.log", base);
+
+  srand(seed);
+  rbtree *ref = new_rbtree();
+  wal_rbtree *w = wal_rbtree_open(base, 64);
+  assert(w != NULL && w->tree->root == w->tree->nil);
+  wal_random_ops(w, ref, n, n / 2);
+  assert(wal_rbtree_close(w) == 0);
+
+  // everything closed cleanly comes back from the log alone
+  w = wal_rbtree_open(base, 64);
+  assert(w != NULL);
+  check_same(w->tree, ref, 2 * n);
+
+  // checkpoint, then more operations on top of the snapshot
+  assert(wal_rbtree_checkpoint(w) == 0);
+  wal_random_ops(w, ref, n, n / 2);
+  assert(wal_rbtree_sync(w) == 0);
+
+  // operations after the last sync are lost in a crash
+  for (int i = 0; i < 10; i++)
+    assert(wal_rbtree_insert(w, n + i) != NULL);
+  wal_crash(w);
+  w = wal_rbtree_open(base, 64);
+  assert(w != NULL);
+  assert(rbtree_find(w->tree, n) == w->tree->nil);
+  check_same(w->tree, ref, 3 * n);
+
+  // a torn record at the end of the log is ignored
+  wal_rbtree_insert(w, n);
+  rbtree_insert(ref, n);
+  assert(wal_rbtree_close(w) == 0);
+  FILE *fp = fopen(log, "ab");
+  fputs("torn", fp);
+  fclose(fp);
+  w = wal_rbtree_open(base, 1);
+  assert(w != NULL);
+  check_same(w->tree, ref, 3 * n);
+
+  // a crash after the snapshot is written but before the log is cleared
+  // must not replay the old log on top of the new snapshot
+  wal_random_ops(w, ref, n / 4, n / 2);
+  assert(rbtree_save_tagged(w->tree, snap, w->epoch + 1) == 0);
+  wal_crash(w);
+  w = wal_rbtree_open(base, 64);
+  assert(w != NULL);
+  check_same(w->tree, ref, 3 * n);
+  assert(wal_rbtree_close(w) == 0);
+
+  unlink(snap);
+  unlink(log);
+  rmdir(dir);
+  delete_rbtree(ref);
+}
+#endif
+
+// a frozen tree should answer lookups exactly like the tree it came from
+void test_frozen(const size_t n, const unsigned int seed)
+{
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++)
+    arr[i] = rand() % (2 * n);
+  rbtree *t = new_rbtree();
+  insert_arr(t, arr, n);
+
+  frozen_rbtree *f = rbtree_freeze(t);
+#ifdef RBTREE_MULTISET
+  // one slot per node, so duplicates appear once
+  size_t distinct = 0;
+  for (node_t *p = rbtree_min(t); p != t->nil; p = rbtree_next(t, p))
+    distinct++;
+  assert(f != NULL && f->n == distinct);
+#else
+  assert(f != NULL && f->n == n);
+#endif
+  assert(f->keys[frozen_min(f)] == rbtree_min(t)->key);
+  assert(f->keys[frozen_max(f)] == rbtree_max(t)->key);
+  for (key_t k = -1; k <= 2 * n + 1; k++)
+  {
+    node_t *p = rbtree_lower_bound(t, k);
+    size_t i = frozen_lower_bound(f, k);
+    assert(p == t->nil ? i == 0 : i != 0 && f->keys[i] == p->key);
+
+    p = rbtree_find(t, k);
+    i = frozen_find(f, k);
+    assert(p == t->nil ? i == 0 : i != 0 && f->keys[i] == k);
+  }
+  delete_frozen_rbtree(f);
+
+  rbtree *e = new_rbtree();
+  f = rbtree_freeze(e);
+  assert(f != NULL && f->n == 0);
+  assert(frozen_min(f) == 0 && frozen_max(f) == 0);
+  assert(frozen_find(f, 0) == 0 && frozen_lower_bound(f, 0) == 0);
+  delete_frozen_rbtree(f);
+
+  free(arr);
+  delete_rbtree(e);
+  delete_rbtree(t);
+}
+
+int main(void)
+{
+  test_init();
+  test_insert_single(1024);
+  test_find_single(512, 1024);
+  test_erase_root(128);
+  test_find_erase_fixed();
+  test_minmax_suite();
+  test_to_array_suite();
+  test_distinct_values();
+  test_duplicate_values();
+  test_multi_instance();
+  test_find_erase_rand(10000, 17);
+#ifdef RB_CORE
+  test_node_reuse();
+#endif
+  test_from_array_suite();
+  test_cursor_suite();
+  test_range_suite();
+  test_find_batch(5000, 3);
+  test_size(2000, 23);
+  test_sort_keys(27);
+  test_batch(3000, 29);
+  test_sharded(20000, 31);
+#ifndef RBTREE_MULTISET
+  test_erase_handles(1500, 25);
+#endif
+#ifdef RB_CORE
+  test_split_join(3000, 5);
+  test_set_ops(4000, 300, 9);
+  test_set_ops(200, 5000, 10);
+  test_set_ops(0, 100, 11);
+  test_set_ops(20000, 20000, 12);
+  // force the fork-join path: trees large enough that the top levels have black
+  // height >= SETOP_PAR_MIN_BH, split over more threads than this machine may have
+  setenv("RBTREE_SETOP_THREADS", "8", 1);
+  test_set_ops(300000, 200000, 13);
+  unsetenv("RBTREE_SETOP_THREADS");
+#endif
+  test_compact(5000, 11);
+  test_persist(3000, 13);
+#ifdef RB_CORE
+  test_mmap(5000, 15);
+  test_wal(4000, 17);
+#endif
+  test_frozen(3000, 19);
+#ifdef RBTREE_ORDER_STAT
+  test_order_stat(2000, 7);
+#endif
+#ifdef RBTREE_INTERVAL
+  test_interval(3000, 33);
+#endif
+#ifdef RBTREE_VALUE_TYPE
+  test_values(1000);
+#endif
+#ifdef RBTREE_MULTISET
+  test_multiset(5000, 21);
+#endif
+#ifdef RBTREE_STATS
+  test_stats(3000);
+#endif
   printf("Passed all tests!\n");
 }